@@ -0,0 +1,159 @@
+#ifndef __ARENA_H_
+#define __ARENA_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Bump allocator that owns every node of one document.
+// Nothing allocated from it is ever freed or destructed individually, instead the whole arena is Reset()
+// once the document is done. Blocks are kept around and reused so after warming up a document costs no mallocs
+// and resetting is O(1).
+struct Arena {
+    static const size_t DefaultBlockSize = 64 * 1024;
+
+    explicit Arena(size_t blockSize = DefaultBlockSize)
+        : BlockSize(blockSize) {}
+
+    ~Arena() {
+        Block* block = First;
+        while (block) {
+            Block* next = block->Next;
+            free(block);
+            block = next;
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        ++Allocations;
+        size_t offset = (Used + align - 1) & ~(align - 1);
+        if (!Current || offset + size > Current->Size) {
+            NextBlock(size + align);
+            offset = (Used + align - 1) & ~(align - 1);
+        }
+        Used = offset + size;
+        return Current->Data() + offset;
+    }
+
+    // Copies 'length' bytes and NUL terminates them.
+    char* CopyString(const char* from, size_t length) {
+        char* to = (char*)Allocate(length + 1, 1);
+        memcpy(to, from, length);
+        to[length] = '\0';
+        return to;
+    }
+
+    // Forgets everything that was allocated. Previous allocations must not be used after this.
+    void Reset() {
+        Current = First;
+        Used = 0;
+    }
+
+    // Bytes in use since the last Reset. Blocks before the current one count as fully used.
+    size_t BytesUsed() const {
+        size_t total = Used;
+        for (Block* block = First; block && block != Current; block = block->Next) {
+            total += block->Size;
+        }
+        return Current ? total : 0;
+    }
+
+    // Allocations and the mallocs of new blocks since the arena was created (see RunStats).
+    size_t Allocations = 0;
+    size_t Mallocs = 0;
+
+private:
+    struct Block {
+        Block* Next;
+        size_t Size;
+
+        char* Data() {
+            return (char*)(this + 1);
+        }
+    };
+
+    // Moves to the next block that can hold 'size' bytes, reusing blocks from before the last Reset if possible.
+    void NextBlock(size_t size) {
+        Block* candidate = Current ? Current->Next : First;
+        while (candidate && candidate->Size < size) {
+            candidate = candidate->Next;
+        }
+
+        if (!candidate) {
+            const size_t blockSize = size > BlockSize ? size : BlockSize;
+            candidate = (Block*)malloc(sizeof(Block) + blockSize);
+            if (!candidate) {
+                throw std::bad_alloc();
+            }
+            ++Mallocs;
+            candidate->Size = blockSize;
+            candidate->Next = nullptr;
+
+            if (Last) {
+                Last->Next = candidate;
+            }
+            else {
+                First = candidate;
+            }
+            Last = candidate;
+        }
+
+        Current = candidate;
+        Used = 0;
+    }
+
+    size_t BlockSize;
+    Block* First = nullptr;
+    Block* Last = nullptr;
+    Block* Current = nullptr;
+    size_t Used = 0;
+};
+
+// std allocator adapter so containers of the nodes can live in the same arena.
+// Deallocation is a no-op, memory is only reclaimed when the arena is reset.
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    Arena* Owner;
+
+    ArenaAllocator(Arena& owner)
+        : Owner(&owner) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : Owner(other.Owner) {}
+
+    T* allocate(size_t count) {
+        return (T*)Owner->Allocate(count * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return Owner == other.Owner;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return Owner != other.Owner;
+    }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+inline void* operator new(size_t size, Arena& arena) {
+    return arena.Allocate(size);
+}
+
+// Only called if a constructor throws, the memory is reclaimed on Reset anyway.
+inline void operator delete(void*, Arena&) {}
+
+#endif //__ARENA_H_
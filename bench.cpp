@@ -0,0 +1,239 @@
+// Per stage throughput of the parser on a generated tweet corpus (make bench).
+//
+// Every stage is timed directly over the same in memory corpus, none is a difference of separate runs:
+//   lex       a run of the scanner alone (LexBuffer)
+//   parse     a run that also builds the records, accepted unchecked and not printed
+//   validate  the outer object checks, timed within a full run (the --stats timers)
+//   print     printing the records (to /dev/null), timed within a full run
+//   total     a full run without the timers
+// The id database starts empty on every run and each time is the best of --rounds.
+//
+// Usage: bench [--size MB] [--retweets %] [--extended %] [--hashtags N] [--escapes %] [--invalid %] [--seed N]
+//              [--rounds N] [--compact] [--tape] [--write path] [--save path] [--baseline path]
+// --write only writes the corpus to 'path' (eg: to feed the parser itself).
+// --save stores the results and --baseline compares against stored ones.
+
+#include "parse_context.h"
+#include "bench_corpus.h"
+#include "run_stats.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+#include <limits>
+#include <algorithm>
+
+struct StageResult {
+    const char* Name;
+    // Seconds, see the top of the file for what is timed.
+    double Seconds;
+};
+
+struct Baseline {
+    std::string Name;
+    double MBps;
+};
+
+// What one run did, to check every stage saw the whole corpus.
+struct RunCounts {
+    size_t Tokens = 0;
+    unsigned long long Records = 0;
+    unsigned long long Accepted = 0;
+};
+
+static std::ostream Discard(nullptr);
+
+// Best of 'rounds' runs of 'settings' (or just the lexer), in seconds.
+// With 'timers' the runs are timed with the --stats timers, which get the best time of each (in seconds).
+static double Measure(const Corpus& corpus, const ParseSettings* settings, FILE* out, int rounds, RunCounts& counts,
+                      double* timers = nullptr) {
+    auto best = std::chrono::duration<double>::max();
+    std::unique_ptr<RunStats> stats(timers ? new RunStats(out, 0) : nullptr);
+    if (timers) {
+        std::fill(timers, timers + (int)StatTimer::Count, std::numeric_limits<double>::max());
+    }
+    for (int round = 0; round < rounds; ++round) {
+        std::unique_ptr<JsonDB> database(new JsonDB());
+        database->Reserve(corpus.Records);
+        ParseSettings run = settings ? *settings : ParseSettings();
+        run.Stats = stats.get();
+        ParseContext ctx(database.get(), run, out);
+        ctx.Parse.Err = &Discard;
+
+        const auto start = std::chrono::steady_clock::now();
+        if (settings) {
+            if (ParseBuffer(ctx, corpus.Text.data(), corpus.Text.size()) != 0) {
+                fprintf(stderr, "The corpus did not parse.\n");
+                exit(1);
+            }
+            ctx.Writer.Flush();
+        }
+        else {
+            counts.Tokens = LexBuffer(ctx, corpus.Text.data(), corpus.Text.size());
+        }
+        best = std::min<std::chrono::duration<double>>(best, std::chrono::steady_clock::now() - start);
+        counts.Records = ctx.RecordCount;
+        counts.Accepted = ctx.AcceptedCount;
+        for (int timer = 0; timers && timer < (int)StatTimer::Count; ++timer) {
+            timers[timer] = std::min(timers[timer], ctx.Stats->Nanos[timer].Get() / 1e9);
+        }
+    }
+    return best.count();
+}
+
+static std::vector<Baseline> LoadBaseline(const char* path) {
+    std::vector<Baseline> stages;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Could not open baseline '%s'.\n", path);
+        return stages;
+    }
+    char name[32];
+    double mbps;
+    while (fscanf(file, "%31s %lf%*[^\n]", name, &mbps) == 2) {
+        stages.push_back(Baseline { name, mbps });
+    }
+    fclose(file);
+    return stages;
+}
+
+int main(int argc, char** argv) {
+    CorpusOptions options;
+    int rounds = 3;
+    bool compact = false;
+    bool tape = false;
+    const char* writePath = nullptr;
+    const char* savePath = nullptr;
+    const char* baselinePath = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--size" && hasValue) {
+            options.Bytes = strtoull(argv[++i], nullptr, 10) << 20;
+        }
+        else if (arg == "--retweets" && hasValue) {
+            options.RetweetShare = atoi(argv[++i]);
+        }
+        else if (arg == "--extended" && hasValue) {
+            options.ExtendedShare = atoi(argv[++i]);
+        }
+        else if (arg == "--hashtags" && hasValue) {
+            options.MaxHashtags = atoi(argv[++i]);
+        }
+        else if (arg == "--escapes" && hasValue) {
+            options.EscapeShare = atoi(argv[++i]);
+        }
+        else if (arg == "--invalid" && hasValue) {
+            options.InvalidShare = atoi(argv[++i]);
+        }
+        else if (arg == "--seed" && hasValue) {
+            options.Seed = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--rounds" && hasValue) {
+            rounds = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--compact") {
+            compact = true;
+        }
+        else if (arg == "--tape") {
+            tape = true;
+        }
+        else if (arg == "--write" && hasValue) {
+            writePath = argv[++i];
+        }
+        else if (arg == "--save" && hasValue) {
+            savePath = argv[++i];
+        }
+        else if (arg == "--baseline" && hasValue) {
+            baselinePath = argv[++i];
+        }
+        else {
+            fprintf(stderr, "Unknown argument '%s'.\n", argv[i]);
+            return 1;
+        }
+    }
+
+    const Corpus corpus = GenerateCorpus(options);
+    if (writePath) {
+        FILE* file = fopen(writePath, "w");
+        if (!file || fwrite(corpus.Text.data(), 1, corpus.Text.size(), file) != corpus.Text.size()) {
+            fprintf(stderr, "Could not write the corpus to '%s'.\n", writePath);
+            return 1;
+        }
+        fclose(file);
+        printf("%zu records (%zu valid), %zu bytes.\n", corpus.Records, corpus.Valid, corpus.Text.size());
+        return 0;
+    }
+
+    FILE* devNull = fopen("/dev/null", "w");
+    ParseSettings parse;
+    parse.Compact = compact;
+    parse.UseTape = tape;
+    parse.SkipChecks = true;
+    parse.SkipPrint = true;
+    ParseSettings print = parse;
+    print.SkipChecks = false;
+    print.SkipPrint = false;
+
+    RunCounts lexed, parsed, timed, printed;
+    double timers[(int)StatTimer::Count];
+    const double lexTime = Measure(corpus, nullptr, devNull, rounds, lexed);
+    const double parseTime = Measure(corpus, &parse, devNull, rounds, parsed);
+    Measure(corpus, &print, devNull, rounds, timed, timers);
+    const double printTime = Measure(corpus, &print, devNull, rounds, printed);
+    fclose(devNull);
+
+    if (parsed.Records != corpus.Records || timed.Accepted != corpus.Valid || printed.Accepted != corpus.Valid) {
+        fprintf(stderr, "Unexpected results: %llu of %zu records parsed, %llu of %zu valid.\n",
+                parsed.Records, corpus.Records, printed.Accepted, corpus.Valid);
+        return 1;
+    }
+
+    const StageResult stages[] = {
+        {"lex", lexTime},
+        {"parse", parseTime},
+        {"validate", timers[(int)StatTimer::Checks]},
+        {"print", timers[(int)StatTimer::Print]},
+        {"total", printTime},
+    };
+
+    const std::vector<Baseline> baseline = baselinePath ? LoadBaseline(baselinePath) : std::vector<Baseline>();
+    const double megabytes = corpus.Text.size() / 1e6;
+
+    printf("%zu records (%zu valid), %.1f MB, %zu tokens, best of %d\n",
+           corpus.Records, corpus.Valid, megabytes, lexed.Tokens, rounds);
+    printf("%-10s %10s %10s %14s", "stage", "seconds", "MB/s", "records/s");
+    printf(baseline.empty() ? "\n" : " %13s %8s\n", "baseline MB/s", "change");
+    for (const StageResult& stage : stages) {
+        if (stage.Seconds <= 0) {
+            printf("%-10s %10s %10s %14s\n", stage.Name, "-", "-", "-");
+            continue;
+        }
+        const double mbps = megabytes / stage.Seconds;
+        printf("%-10s %10.4f %10.1f %14.0f", stage.Name, stage.Seconds, mbps, corpus.Records / stage.Seconds);
+        for (const Baseline& old : baseline) {
+            if (old.Name == stage.Name) {
+                printf(" %13.1f %+7.1f%%", old.MBps, (mbps / old.MBps - 1) * 100);
+            }
+        }
+        printf("\n");
+    }
+
+    if (savePath) {
+        FILE* file = fopen(savePath, "w");
+        if (!file) {
+            fprintf(stderr, "Could not write the results to '%s'.\n", savePath);
+            return 1;
+        }
+        for (const StageResult& stage : stages) {
+            if (stage.Seconds <= 0) {
+                continue;
+            }
+            fprintf(file, "%s %.3f %.0f\n", stage.Name, megabytes / stage.Seconds, corpus.Records / stage.Seconds);
+        }
+        fclose(file);
+    }
+    return 0;
+}
@@ -0,0 +1,211 @@
+#include "bench_corpus.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Piece {
+    const char* Json;
+    // Characters (code points) of the decoded text.
+    unsigned Chars;
+};
+
+const Piece Words[] = {
+    {"the", 3}, {"a", 1}, {"of", 2}, {"and", 3}, {"to", 2}, {"in", 2}, {"is", 2}, {"for", 3}, {"on", 2},
+    {"with", 4}, {"just", 4}, {"new", 3}, {"today", 5}, {"love", 4}, {"great", 5}, {"thanks", 6},
+    {"watch", 5}, {"live", 4}, {"news", 4}, {"people", 6}, {"game", 4}, {"music", 5}, {"video", 5},
+    {"https://t.co/U7Se4NM7Eu", 23}, {"@FloodSocial", 12}, {"naïve", 5}, {"über", 4}, {"日本語", 3},
+};
+
+const Piece Escaped[] = {
+    {"caf\\u00e9", 4}, {"\\u00e9t\\u00e9", 3}, {"\\\"quoted\\\"", 8}, {"line\\nbreak", 10},
+    {"\\u2764", 1}, {"\\/slash", 6}, {"\\u2026", 1}, {"\\\\", 1},
+};
+
+const char* const Tags[] = {
+    "news", "music", "WorldCup", "tbt", "AI", "parsingJSON", "GeoTagged", "documentation", "love", "NowPlaying",
+    "MondayMotivation", "gamedev", "photography", "travel", "food",
+};
+
+template <typename T, size_t N>
+constexpr size_t Count(const T (&)[N]) {
+    return N;
+}
+
+// Text of a "text"/"full_text" being generated, with its length and hashtags as JString counts them.
+struct TextBuilder {
+    std::string Json;
+    unsigned Chars = 0;
+    std::vector<std::pair<const char*, unsigned>> Hashtags;
+
+    void Add(const Piece& piece) {
+        if (Chars) {
+            Json += ' ';
+            ++Chars;
+        }
+        Json += piece.Json;
+        Chars += piece.Chars;
+    }
+
+    void AddTag(const char* tag) {
+        const std::string text = std::string("#") + tag;
+        Add(Piece { text.c_str(), 0 });
+        Hashtags.emplace_back(tag, Chars);
+        Chars += text.length();
+    }
+};
+
+struct Generator {
+    const CorpusOptions& Options;
+    std::mt19937 Rng;
+    Corpus& Out;
+
+    Generator(const CorpusOptions& options, Corpus& out)
+        : Options(options)
+        , Rng(options.Seed)
+        , Out(out) {}
+
+    bool Chance(int percent) {
+        return (int)(Rng() % 100) < percent;
+    }
+
+    const Piece& Word() {
+        if (Chance(Options.EscapeShare)) {
+            return Escaped[Rng() % Count(Escaped)];
+        }
+        return Words[Rng() % Count(Words)];
+    }
+
+    // Words up to 'chars' characters, with up to 'hashtags' hashtags spread among them.
+    TextBuilder Text(unsigned chars, int hashtags) {
+        TextBuilder text;
+        for (;;) {
+            if (hashtags > 0 && Chance(25)) {
+                const char* tag = Tags[Rng() % Count(Tags)];
+                if (text.Chars + 2 + std::char_traits<char>::length(tag) > chars) {
+                    break;
+                }
+                text.AddTag(tag);
+                --hashtags;
+            }
+            else {
+                const Piece& word = Word();
+                if (text.Chars + 1 + word.Chars > chars) {
+                    break;
+                }
+                text.Add(word);
+            }
+        }
+        return text;
+    }
+
+    void Hashtags(const TextBuilder& text) {
+        Out.Text += "\"entities\":{\"hashtags\":[";
+        for (size_t i = 0; i < text.Hashtags.size(); ++i) {
+            const auto& [tag, begin] = text.Hashtags[i];
+            const unsigned end = begin + std::char_traits<char>::length(tag) + 1;
+            Out.Text += i ? "," : "";
+            Out.Text += "{\"text\":\"" + std::string(tag) + "\",\"indices\":[" + std::to_string(begin) + ","
+                + std::to_string(end) + "]}";
+        }
+        Out.Text += "]}";
+    }
+
+    void Record(size_t index) {
+        const bool invalid = Chance(Options.InvalidShare);
+        const bool retweet = Chance(Options.RetweetShare);
+        const bool extended = !retweet && Chance(Options.ExtendedShare);
+        const int hashtags = Options.MaxHashtags > 0 ? Rng() % (Options.MaxHashtags + 1) : 0;
+        // Every tweet has its own user, user ids are deduplicated like id_str.
+        const std::string user = std::to_string(100000000 + index);
+        std::string& out = Out.Text;
+
+        out += "{";
+        if (!invalid || extended) {
+            char date[48];
+            const time_t time = 1525974117 + index * 3;
+            struct tm parts;
+            gmtime_r(&time, &parts);
+            strftime(date, sizeof(date), "%a %b %d %H:%M:%S +0000 %Y", &parts);
+            out += "\"created_at\":\"" + std::string(date) + "\",";
+        }
+        out += "\"id_str\":\"" + std::to_string(994633657141813248ULL + index) + "\",";
+
+        TextBuilder text;
+        if (retweet) {
+            const std::string author = "author_" + std::to_string(Rng() % 5000);
+            TextBuilder original = Text(110, hashtags);
+            text.Json = "RT @" + author + ": ";
+            text.Chars = text.Json.length();
+            for (const auto& [tag, begin] : original.Hashtags) {
+                text.Hashtags.emplace_back(tag, text.Chars + begin);
+            }
+            text.Json += original.Json;
+            text.Chars += original.Chars;
+            out += "\"text\":\"" + text.Json + "\",";
+            out += "\"retweeted_status\":{\"created_at\":\"Thu May 10 17:41:57 +0000 2018\",\"text\":\"" + original.Json
+                + "\",\"user\":{\"name\":\"Original Author\",\"screen_name\":\"" + author + "\"},\"retweet_count\":"
+                + std::to_string(Rng() % 100000) + "},";
+        }
+        else if (extended) {
+            TextBuilder full = Text(150 + Rng() % 130, hashtags);
+            TextBuilder shown = Text(120, 0);
+            shown.Add(Piece { "\\u2026", 1 });
+            // An invalid extended tweet claims the length of the full text.
+            const unsigned shownRange = invalid ? full.Chars : shown.Chars;
+            out += "\"text\":\"" + shown.Json + "\",\"display_text_range\":[0," + std::to_string(shownRange)
+                + "],\"truncated\":true,";
+            out += "\"extended_tweet\":{\"full_text\":\"" + full.Json + "\",\"display_text_range\":[0,"
+                + std::to_string(full.Chars) + "],";
+            Hashtags(full);
+            out += "},";
+            text = shown;
+        }
+        else {
+            text = Text(40 + Rng() % 100, hashtags);
+            out += "\"text\":\"" + text.Json + "\",\"truncated\":false,";
+        }
+
+        out += "\"user\":{\"id\":" + user + ",\"id_str\":\"" + user + "\",\"name\":\"User " + user
+            + "\",\"screen_name\":\"user_" + user + "\",\"location\":\"Patras, Greece\",\"verified\":"
+            + (Chance(5) ? "true" : "false") + ",\"followers_count\":" + std::to_string(Rng() % 1000000)
+            + ",\"friends_count\":" + std::to_string(Rng() % 5000) + "},";
+
+        if (Chance(10)) {
+            char coordinates[64];
+            snprintf(coordinates, sizeof(coordinates), "[%.6f,%.6f]", -180 + (Rng() % 360000000) / 1e6,
+                     -90 + (Rng() % 180000000) / 1e6);
+            out += "\"coordinates\":{\"type\":\"Point\",\"coordinates\":" + std::string(coordinates) + "},";
+        }
+        else {
+            out += "\"coordinates\":null,";
+        }
+        if (!extended) {
+            Hashtags(text);
+            out += ",";
+        }
+        out += "\"lang\":\"en\",\"retweet_count\":" + std::to_string(Rng() % 1000) + ",\"favorite_count\":"
+            + std::to_string(Rng() % 5000) + ",\"favorited\":false,\"timestamp_ms\":\""
+            + std::to_string((1525974117ULL + index * 3) * 1000) + "\"}\n";
+
+        ++Out.Records;
+        if (!invalid) {
+            ++Out.Valid;
+        }
+    }
+};
+
+} // namespace
+
+Corpus GenerateCorpus(const CorpusOptions& options) {
+    Corpus corpus;
+    corpus.Text.reserve(options.Bytes + 4096);
+    Generator generator(options, corpus);
+    while (corpus.Text.size() < options.Bytes) {
+        generator.Record(corpus.Records);
+    }
+    return corpus;
+}
@@ -0,0 +1,33 @@
+#ifndef __BENCH_CORPUS_H_
+#define __BENCH_CORPUS_H_
+
+#include <stddef.h>
+#include <string>
+
+// What the generated tweets look like. Shares are percentages of the records.
+struct CorpusOptions {
+    // Generates records until the corpus is at least this big.
+    size_t Bytes = 64 << 20;
+    int RetweetShare = 20;
+    // Truncated tweets with an extended_tweet (full_text, display ranges and entities).
+    int ExtendedShare = 30;
+    // Every text gets 0 to this many hashtags.
+    int MaxHashtags = 3;
+    // Share of the words of a text that have \u (or other) escapes.
+    int EscapeShare = 10;
+    // Records that parse but are rejected as outer objects (missing created_at or a wrong display range).
+    int InvalidShare = 2;
+    unsigned Seed = 42;
+};
+
+// Newline delimited tweets, the same options always give the same text.
+struct Corpus {
+    std::string Text;
+    size_t Records = 0;
+    // Records that pass validation, the rest are the invalid ones.
+    size_t Valid = 0;
+};
+
+Corpus GenerateCorpus(const CorpusOptions& options);
+
+#endif //__BENCH_CORPUS_H_
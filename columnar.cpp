@@ -0,0 +1,159 @@
+#include "columnar.h"
+#include "twitter_date.h"
+
+#include <charconv>
+#include <algorithm>
+
+static_assert(sizeof(columnar::RowGroup) % 8 == 0 && sizeof(columnar::Trailer) % 8 == 0, "Footer parts must stay aligned");
+
+void BlobColumn::Append(const BlobColumn& other, size_t from, size_t count) {
+    const uint64_t begin = other.Offsets[from];
+    const uint64_t shift = Bytes.size() - begin;
+    Bytes.append(other.Bytes, begin, other.Offsets[from + count] - begin);
+    for (size_t i = from + 1; i <= from + count; ++i) {
+        Offsets.push_back(other.Offsets[i] + shift);
+    }
+}
+
+void ColumnBatch::Add(const JObject& tweet) {
+    // id_str is all digits (the grammar only takes D_ID_STR) but it may have more than a uint64_t holds.
+    const std::string_view idStr = tweet.Members.IdStr->Text;
+    uint64_t id = 0;
+    const std::from_chars_result parsed = std::from_chars(idStr.data(), idStr.data() + idStr.length(), id);
+    const bool fits = parsed.ec == std::errc() && parsed.ptr == idStr.data() + idStr.length();
+    Id.push_back(fits ? id : 0);
+    IdStr.Add(fits ? std::string_view() : idStr);
+
+    const JSpecialMembers& user = tweet.Members.User->Members;
+    UserId.push_back(user.UId ? *user.UId : -1);
+
+    long long time = 0;
+    ParseCreatedAt(tweet.Members.CreatedAt->Text, time);
+    CreatedAt.push_back(time);
+
+    Truncated.push_back(tweet.ExMembers.Truncated && *tweet.ExMembers.Truncated);
+    Text.Add(tweet.Members.Text->Text);
+
+    const JString* text = tweet.Members.Text;
+    const JObject* extended = tweet.ExMembers.ExTweet;
+    if (extended && extended->ExMembers.FullText) {
+        text = extended->ExMembers.FullText;
+        FullText.Add(text->Text);
+    }
+    else {
+        FullText.Add(std::string_view());
+    }
+    ScreenName.Add(user.UScreenName->Text);
+
+    for (const HashTagData& hashtag : text->Hashtags) {
+        if (Hashtags.Bytes.size() > Hashtags.Offsets.back()) {
+            Hashtags.Bytes.push_back(' ');
+        }
+        Hashtags.Bytes.append(hashtag.Tag.data(), hashtag.Tag.length());
+    }
+    Hashtags.Offsets.push_back(Hashtags.Bytes.size());
+}
+
+template <typename T>
+static void AppendValues(std::vector<T>& to, const std::vector<T>& from, size_t first, size_t count) {
+    to.insert(to.end(), from.begin() + first, from.begin() + first + count);
+}
+
+static void AppendValues(BlobColumn& to, const BlobColumn& from, size_t first, size_t count) {
+    to.Append(from, first, count);
+}
+
+template <typename T>
+static void ClearValues(std::vector<T>& values) {
+    values.clear();
+}
+
+static void ClearValues(BlobColumn& values) {
+    values.Clear();
+}
+
+void ColumnBatch::Append(const ColumnBatch& other, size_t from, size_t count) {
+#define APPEND_COLUMN(Name, Type) AppendValues(Name, other.Name, from, count);
+    COLUMNAR_COLUMNS(APPEND_COLUMN)
+#undef APPEND_COLUMN
+}
+
+void ColumnBatch::Clear() {
+#define CLEAR_COLUMN(Name, Type) ClearValues(Name);
+    COLUMNAR_COLUMNS(CLEAR_COLUMN)
+#undef CLEAR_COLUMN
+}
+
+ColumnarFile::ColumnarFile(FILE* out, size_t rowGroupRows)
+    : RowGroupRows(rowGroupRows ? rowGroupRows : DefaultRowGroupRows)
+    , Out(out) {
+    WriteAligned(columnar::Magic, sizeof(columnar::Magic));
+}
+
+void ColumnarFile::Add(ColumnBatch& batch) {
+    std::lock_guard<std::mutex> guard(Lock);
+    size_t from = 0;
+    while (from < batch.Rows()) {
+        const size_t count = std::min(batch.Rows() - from, RowGroupRows - Pending.Rows());
+        Pending.Append(batch, from, count);
+        from += count;
+        if (Pending.Rows() == RowGroupRows) {
+            WriteGroup();
+        }
+    }
+    batch.Clear();
+}
+
+bool ColumnarFile::Close() {
+    std::lock_guard<std::mutex> guard(Lock);
+    if (Pending.Rows()) {
+        WriteGroup();
+    }
+    columnar::Trailer trailer;
+    trailer.Index = Position;
+    trailer.Groups = Groups.size();
+    trailer.Rows = Rows;
+    trailer.Version = columnar::Version;
+    trailer.Columns = (uint32_t)columnar::Column::Count;
+    std::copy(columnar::Magic, columnar::Magic + sizeof(columnar::Magic), trailer.Magic);
+
+    WriteAligned(Groups.data(), Groups.size() * sizeof(columnar::RowGroup));
+    WriteAligned(&trailer, sizeof(trailer));
+    Failed = fflush(Out) != 0 || Failed;
+    return !Failed;
+}
+
+void ColumnarFile::WriteGroup() {
+    columnar::RowGroup group;
+    group.Rows = Pending.Rows();
+#define WRITE_COLUMN(Name, Type) group.Columns[(int)columnar::Column::Name] = WriteColumn(Pending.Name);
+    COLUMNAR_COLUMNS(WRITE_COLUMN)
+#undef WRITE_COLUMN
+    Rows += group.Rows;
+    Groups.push_back(group);
+    Pending.Clear();
+}
+
+void ColumnarFile::WriteAligned(const void* data, size_t length) {
+    static const char Padding[8] = {};
+    const size_t padding = (8 - length % 8) % 8;
+    if (fwrite(data, 1, length, Out) != length || fwrite(Padding, 1, padding, Out) != padding) {
+        Failed = true;
+    }
+    Position += length + padding;
+}
+
+template <typename T>
+columnar::ColumnChunk ColumnarFile::WriteColumn(const std::vector<T>& values) {
+    const columnar::ColumnChunk chunk { Position, values.size() * sizeof(T) };
+    WriteAligned(values.data(), chunk.Length);
+    return chunk;
+}
+
+columnar::ColumnChunk ColumnarFile::WriteColumn(const BlobColumn& values) {
+    const size_t offsets = values.Offsets.size() * sizeof(uint64_t);
+    const columnar::ColumnChunk chunk { Position, offsets + values.Bytes.size() };
+    WriteAligned(values.Offsets.data(), offsets);
+    WriteAligned(values.Bytes.data(), values.Bytes.size());
+    return chunk;
+}
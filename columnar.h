@@ -0,0 +1,156 @@
+#ifndef __COLUMNAR_H_
+#define __COLUMNAR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+
+#include "json_classes.h"
+
+// Columnar output of the accepted tweets (--columnar), a struct of arrays file that readers can mmap
+// and scan one column at a time. Everything is little endian and every part starts 8 byte aligned.
+//
+//   Magic
+//   row group 0: column 0, column 1, ... column Count - 1
+//   row group 1: ...
+//   RowGroup[groups]   the footer index, one entry per row group
+//   Trailer
+//
+// A reader maps the file, reads the Trailer from the end and the index from Trailer::Index.
+// Fixed width columns are 'rows' values of their type. Blob columns are 'rows + 1' uint64 offsets
+// followed by the bytes of the values, value i is bytes [offsets[i], offsets[i + 1]).
+namespace columnar {
+
+constexpr char Magic[8] = { 'T', 'W', 'C', 'O', 'L', 'U', 'M', 'N' };
+constexpr uint32_t Version = 2;
+
+// Name:  Column enumerator.
+// Type:  value type of a fixed width column, Blob for offset + bytes columns.
+#define COLUMNAR_COLUMNS(X) \
+    X(Id,         uint64_t) /* id_str as a number, 0 if it doesn't fit (see IdStr) */ \
+    X(UserId,     int64_t)  /* user.id, -1 without one */ \
+    X(CreatedAt,  int64_t)  /* created_at, seconds since the epoch */ \
+    X(Truncated,  uint8_t)  /* 1 if truncated is true */ \
+    X(Text,       Blob) \
+    X(FullText,   Blob)     /* extended_tweet.full_text, empty without one */ \
+    X(ScreenName, Blob)     /* user.screen_name */ \
+    X(Hashtags,   Blob)     /* hashtags of the (full) text, separated by spaces */ \
+    X(IdStr,      Blob)     /* id_str when it doesn't fit in Id, empty otherwise */
+
+#define COLUMNAR_ENUMERATOR(Name, Type) Name,
+enum class Column : uint32_t {
+    COLUMNAR_COLUMNS(COLUMNAR_ENUMERATOR)
+    Count
+};
+#undef COLUMNAR_ENUMERATOR
+
+// Where a column of a row group is in the file.
+struct ColumnChunk {
+    uint64_t Offset;
+    uint64_t Length;
+};
+
+// Footer index entry of a row group.
+struct RowGroup {
+    uint64_t Rows;
+    ColumnChunk Columns[(int)Column::Count];
+};
+
+// Last bytes of the file.
+struct Trailer {
+    // Offset of the footer index, how many row groups it has and their rows all together.
+    uint64_t Index;
+    uint64_t Groups;
+    uint64_t Rows;
+    uint32_t Version;
+    uint32_t Columns;
+    char Magic[8];
+};
+
+} // namespace columnar
+
+// Values of a blob column: offsets of each value in Bytes, starting with 0.
+struct BlobColumn {
+    std::vector<uint64_t> Offsets{0};
+    std::string Bytes;
+
+    void Add(std::string_view value) {
+        Bytes.append(value.data(), value.length());
+        Offsets.push_back(Bytes.size());
+    }
+
+    // Appends 'count' values of 'other' from 'from' on.
+    void Append(const BlobColumn& other, size_t from, size_t count);
+
+    void Clear() {
+        Offsets.assign(1, 0);
+        Bytes.clear();
+    }
+};
+
+// In memory type of each column Type.
+#define COLUMNAR_VALUES_uint64_t    std::vector<uint64_t>
+#define COLUMNAR_VALUES_int64_t     std::vector<int64_t>
+#define COLUMNAR_VALUES_uint8_t     std::vector<uint8_t>
+#define COLUMNAR_VALUES_Blob        BlobColumn
+
+#define COLUMNAR_DECLARE_VALUES(Name, Type) COLUMNAR_VALUES_##Type Name;
+
+// Columns of some accepted tweets, in memory.
+struct ColumnBatch {
+    COLUMNAR_COLUMNS(COLUMNAR_DECLARE_VALUES)
+
+    size_t Rows() const {
+        return Id.size();
+    }
+
+    // Adds a row for a valid outer object (FormsValidOuterObject).
+    void Add(const JObject& tweet);
+
+    // Appends 'count' rows of 'other' from 'from' on.
+    void Append(const ColumnBatch& other, size_t from, size_t count);
+
+    void Clear();
+};
+
+#undef COLUMNAR_DECLARE_VALUES
+
+// The --columnar file of a run. Thread safe, shared by every parse of the run.
+struct ColumnarFile {
+    // Rows per row group unless said otherwise.
+    static const size_t DefaultRowGroupRows = 64 * 1024;
+
+    ColumnarFile(FILE* out, size_t rowGroupRows = DefaultRowGroupRows);
+
+    ColumnarFile(const ColumnarFile&) = delete;
+    ColumnarFile& operator=(const ColumnarFile&) = delete;
+
+    // Takes the rows of 'batch' (it is cleared), every full row group is written out right away.
+    void Add(ColumnBatch& batch);
+
+    // Writes the last row group and the footer. Returns false if any write failed.
+    bool Close();
+
+    const size_t RowGroupRows;
+
+private:
+    void WriteGroup();
+    void WriteAligned(const void* data, size_t length);
+    // Writes the values of a column of the current row group, returns where they are.
+    template <typename T>
+    columnar::ColumnChunk WriteColumn(const std::vector<T>& values);
+    columnar::ColumnChunk WriteColumn(const BlobColumn& values);
+
+    FILE* Out;
+    uint64_t Position = 0;
+    uint64_t Rows = 0;
+    bool Failed = false;
+    ColumnBatch Pending;
+    std::vector<columnar::RowGroup> Groups;
+    std::mutex Lock;
+};
+
+#endif //__COLUMNAR_H_
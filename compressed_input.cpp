@@ -0,0 +1,321 @@
+#include "compressed_input.h"
+
+#include <string.h>
+#include <algorithm>
+#include <zlib.h>
+#ifdef PARSER_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// How much of a compressed stream is read at a time.
+const size_t InputBlockSize = 1 << 20;
+
+// Longest piece of the input given to zlib at once, its lengths are 32 bits.
+const size_t MaxZlibInput = 1 << 30;
+
+} // namespace
+
+Compression DetectCompression(const char* head, size_t length) {
+    if (length >= 2 && (unsigned char)head[0] == 0x1f && (unsigned char)head[1] == 0x8b) {
+        return Compression::Gzip;
+    }
+    if (length >= 4 && memcmp(head, "\x28\xb5\x2f\xfd", 4) == 0) {
+        return Compression::Zstd;
+    }
+    return Compression::None;
+}
+
+bool MayBeCompressed(FILE* in) {
+    const int first = getc(in);
+    if (first == EOF) {
+        return false;
+    }
+    ungetc(first, in);
+    return first == 0x1f || first == 0x28;
+}
+
+const char* CompressionName(Compression format) {
+    switch (format) {
+        case Compression::Gzip: return "gzip";
+        case Compression::Zstd: return "zstd";
+        default: return "none";
+    }
+}
+
+struct CompressedInput::Decoder {
+    virtual ~Decoder() {}
+
+    // Fills [out, out + max) from the input. Less than 'max' bytes means the end of the input, or an 'error'.
+    virtual size_t Decompress(CompressedInput& input, char* out, size_t max, std::string& error) = 0;
+
+protected:
+    // Whether there are compressed bytes left, reads more if needed.
+    static bool More(CompressedInput& input) {
+        return input.InPos < input.InLength || input.FillInput();
+    }
+
+    // The compressed bytes read but not decoded yet.
+    static const char* Pending(const CompressedInput& input, size_t& length) {
+        length = input.InLength - input.InPos;
+        return input.InData + input.InPos;
+    }
+
+    static void Consume(CompressedInput& input, size_t length) {
+        input.InPos += length;
+    }
+};
+
+namespace {
+
+struct PlainDecoder : CompressedInput::Decoder {
+    size_t Decompress(CompressedInput& input, char* out, size_t max, std::string& error) override;
+};
+
+struct GzipDecoder : CompressedInput::Decoder {
+    z_stream Stream {};
+    // The last gzip member is complete, another one may follow.
+    bool MemberEnded = false;
+
+    GzipDecoder() {
+        // 16: gzip wrapper only.
+        inflateInit2(&Stream, 16 + MAX_WBITS);
+    }
+
+    ~GzipDecoder() {
+        inflateEnd(&Stream);
+    }
+
+    size_t Decompress(CompressedInput& input, char* out, size_t max, std::string& error) override;
+};
+
+#ifdef PARSER_ZSTD
+struct ZstdDecoder : CompressedInput::Decoder {
+    ZSTD_DStream* Stream = ZSTD_createDStream();
+    // The last frame is complete, another one may follow.
+    bool FrameEnded = true;
+
+    ~ZstdDecoder() {
+        ZSTD_freeDStream(Stream);
+    }
+
+    size_t Decompress(CompressedInput& input, char* out, size_t max, std::string& error) override;
+};
+#endif
+
+} // namespace
+
+size_t PlainDecoder::Decompress(CompressedInput& input, char* out, size_t max, std::string& /*error*/) {
+    size_t length = 0;
+    while (length < max && More(input)) {
+        size_t pending;
+        const char* data = Pending(input, pending);
+        const size_t count = std::min(max - length, pending);
+        memcpy(out + length, data, count);
+        Consume(input, count);
+        length += count;
+    }
+    return length;
+}
+
+size_t GzipDecoder::Decompress(CompressedInput& input, char* out, size_t max, std::string& error) {
+    Stream.next_out = (Bytef*)out;
+    Stream.avail_out = (uInt)max;
+    while (Stream.avail_out) {
+        // Even without more input zlib may still have output pending.
+        const bool more = More(input);
+        if (more && MemberEnded) {
+            inflateReset(&Stream);
+            MemberEnded = false;
+        }
+        const uInt before = Stream.avail_out;
+        size_t pending;
+        const char* data = Pending(input, pending);
+        Stream.next_in = (Bytef*)data;
+        Stream.avail_in = (uInt)std::min(pending, MaxZlibInput);
+        const int result = MemberEnded ? Z_STREAM_END : inflate(&Stream, Z_NO_FLUSH);
+        Consume(input, (const char*)Stream.next_in - data);
+
+        if (result == Z_STREAM_END) {
+            MemberEnded = true;
+        }
+        else if (result != Z_OK && result != Z_BUF_ERROR) {
+            error = Stream.msg ? Stream.msg : "corrupt gzip data";
+            break;
+        }
+        if (!more && Stream.avail_out == before) {
+            if (!MemberEnded) {
+                error = "the gzip data is truncated";
+            }
+            break;
+        }
+    }
+    return max - Stream.avail_out;
+}
+
+#ifdef PARSER_ZSTD
+size_t ZstdDecoder::Decompress(CompressedInput& input, char* out, size_t max, std::string& error) {
+    ZSTD_outBuffer output { out, max, 0 };
+    while (output.pos < output.size) {
+        // Even without more input zstd may still have output pending.
+        const bool more = More(input);
+        const size_t before = output.pos;
+        size_t pending;
+        const char* data = Pending(input, pending);
+        ZSTD_inBuffer in { data, pending, 0 };
+        const size_t result = ZSTD_decompressStream(Stream, &output, &in);
+        Consume(input, in.pos);
+
+        if (ZSTD_isError(result)) {
+            error = ZSTD_getErrorName(result);
+            break;
+        }
+        // Without any input a new frame is awaited, that doesn't make the last one incomplete.
+        if (in.pos || output.pos != before) {
+            FrameEnded = result == 0;
+        }
+        if (!more && output.pos == before) {
+            if (!FrameEnded) {
+                error = "the zstd data is truncated";
+            }
+            break;
+        }
+    }
+    return output.pos;
+}
+#endif
+
+CompressedInput::CompressedInput(const char* data, size_t length)
+    : InData(data)
+    , InLength(length) {
+    Detected = DetectCompression(data, length);
+    Start();
+}
+
+CompressedInput::CompressedInput(FILE* in)
+    : In(in)
+    , InBuffer(new char[InputBlockSize]) {
+    InData = InBuffer.get();
+    InLength = fread(InBuffer.get(), 1, 4, in);
+    Detected = DetectCompression(InData, InLength);
+    Start();
+}
+
+CompressedInput::~CompressedInput() {
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        Stop = true;
+    }
+    Changed.notify_all();
+    if (Worker.joinable()) {
+        Worker.join();
+    }
+}
+
+void CompressedInput::Start() {
+    switch (Detected) {
+        case Compression::None:
+            Decode.reset(new PlainDecoder());
+            break;
+        case Compression::Gzip:
+            Decode.reset(new GzipDecoder());
+            break;
+        case Compression::Zstd:
+#ifdef PARSER_ZSTD
+            Decode.reset(new ZstdDecoder());
+#endif
+            break;
+    }
+    if (!Decode) {
+        Failure = "zstd input needs a parser built with ZSTD=1";
+        Done = true;
+        return;
+    }
+
+    for (auto& block : Blocks) {
+        block.reset(new char[Headroom + BlockSize]);
+    }
+    Worker = std::thread(&CompressedInput::Run, this);
+}
+
+bool CompressedInput::FillInput() {
+    if (!In) {
+        return false;
+    }
+    InData = InBuffer.get();
+    InPos = 0;
+    InLength = fread(InBuffer.get(), 1, InputBlockSize, In);
+    return InLength > 0;
+}
+
+void CompressedInput::Run() {
+    std::string error;
+    while (true) {
+        size_t slot;
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            Changed.wait(lock, [this] { return Stop || Filled - Released < BlockCount; });
+            if (Stop) {
+                return;
+            }
+            slot = Filled % BlockCount;
+        }
+
+        // The reader never holds this block: it only gets the ones before Filled.
+        const size_t length = Decode->Decompress(*this, Blocks[slot].get() + Headroom, BlockSize, error);
+        const bool end = length < BlockSize || !error.empty();
+
+        {
+            std::lock_guard<std::mutex> lock(Lock);
+            if (length) {
+                Lengths[slot] = length;
+                ++Filled;
+            }
+            if (end) {
+                Failure = error;
+                Done = true;
+            }
+        }
+        Changed.notify_all();
+        if (end) {
+            return;
+        }
+    }
+}
+
+bool CompressedInput::Next(char*& data, size_t& length) {
+    std::unique_lock<std::mutex> lock(Lock);
+    if (Holding) {
+        ++Released;
+        Holding = false;
+        Changed.notify_all();
+    }
+    Changed.wait(lock, [this] { return Filled > Released || Done; });
+    if (Filled == Released) {
+        return false;
+    }
+    const size_t slot = Released % BlockCount;
+    data = Blocks[slot].get() + Headroom;
+    length = Lengths[slot];
+    Holding = true;
+    return true;
+}
+
+size_t CompressedInput::Read(char* out, size_t max) {
+    while (ReadLength == 0) {
+        if (!Next(ReadData, ReadLength)) {
+            return 0;
+        }
+    }
+    const size_t count = std::min(max, ReadLength);
+    memcpy(out, ReadData, count);
+    ReadData += count;
+    ReadLength -= count;
+    return count;
+}
+
+std::string CompressedInput::Error() {
+    std::lock_guard<std::mutex> lock(Lock);
+    return Failure;
+}
@@ -0,0 +1,104 @@
+#ifndef __COMPRESSED_INPUT_H_
+#define __COMPRESSED_INPUT_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Input formats, told apart by their first bytes.
+enum class Compression {
+    None,
+    // 1f 8b, also several gzip members one after another (eg: pigz, concatenated archives).
+    Gzip,
+    // 28 b5 2f fd, any number of frames. Only decoded by builds with ZSTD=1 (see the Makefile).
+    Zstd
+};
+
+// Format of the input that starts with the 'length' bytes at 'head'.
+Compression DetectCompression(const char* head, size_t length);
+
+// Whether the stream 'in' may be compressed, from its first byte (which is left unread).
+// Neither magic starts with a byte that valid JSON can start with.
+bool MayBeCompressed(FILE* in);
+
+const char* CompressionName(Compression format);
+
+// Compressed input, decompressed on a thread of its own so that reading and decompressing overlap with parsing.
+// The thread fills a ring of large blocks which the scanner reads in place (see Next), it only waits when
+// all of them are full.
+struct CompressedInput {
+    static const size_t BlockSize = 4 << 20;
+    static const size_t BlockCount = 4;
+    // Bytes free before the data of each block, where the scanner moves the unscanned end of the previous
+    // block (a token cut by the block boundary) to keep scanning without copying the block.
+    static const size_t Headroom = 64 * 1024;
+
+    // Decompresses 'length' bytes at 'data' (eg: a MappedFile), which must stay valid for the life of the input.
+    CompressedInput(const char* data, size_t length);
+    // Decompresses the stream 'in'. Input that turns out not to be compressed is passed through as it is.
+    explicit CompressedInput(FILE* in);
+    // Stops the thread if the input was not read to the end.
+    ~CompressedInput();
+
+    CompressedInput(const CompressedInput&) = delete;
+    CompressedInput& operator=(const CompressedInput&) = delete;
+
+    Compression Format() const {
+        return Detected;
+    }
+
+    // Gives the next block of decompressed bytes and hands the previous one back to the thread: the bytes
+    // of the previous block must not be used after this. Up to Headroom bytes before 'data' may be written.
+    // Returns false at the end of the input.
+    bool Next(char*& data, size_t& length);
+
+    // Copies up to 'max' decompressed bytes to 'out'. Returns 0 at the end of the input.
+    // For scanners with a buffer of their own, don't mix with Next.
+    size_t Read(char* out, size_t max);
+
+    // Why the input ended early (corrupt or truncated), empty if it was decompressed completely.
+    std::string Error();
+
+    // The decoder of a format.
+    struct Decoder;
+
+private:
+    void Start();
+    void Run();
+    // Gets more compressed bytes into [InData + InPos, InData + InLength). Returns false at the end of the input.
+    bool FillInput();
+
+    Compression Detected = Compression::None;
+
+    // Compressed input: all of it for memory, the last bytes read from In for streams.
+    const char* InData = nullptr;
+    size_t InLength = 0;
+    size_t InPos = 0;
+    FILE* In = nullptr;
+    std::unique_ptr<char[]> InBuffer;
+    std::unique_ptr<Decoder> Decode;
+
+    std::unique_ptr<char[]> Blocks[BlockCount];
+    size_t Lengths[BlockCount];
+    // Blocks filled by the thread and handed back by the reader so far, the ring has Filled - Released in use.
+    size_t Filled = 0;
+    size_t Released = 0;
+    // The reader has the block Released % BlockCount.
+    bool Holding = false;
+    bool Done = false;
+    bool Stop = false;
+    std::string Failure;
+    std::mutex Lock;
+    std::condition_variable Changed;
+    std::thread Worker;
+
+    // Where Read is in the block it holds.
+    char* ReadData = nullptr;
+    size_t ReadLength = 0;
+};
+
+#endif //__COMPRESSED_INPUT_H_
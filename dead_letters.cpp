@@ -0,0 +1,30 @@
+#include "dead_letters.h"
+#include "json_writer.h"
+
+void DeadLetterQueue::Write(const DeadLetter& letter, size_t offset, int lines) {
+    // Formatted outside of the lock, written with a single fwrite so lines of other threads never mix.
+    JsonWriter line(nullptr, false);
+    line.Write("{\"offset\":");
+    line.WriteInt(letter.Offset + offset);
+    line.Write(",\"line\":");
+    line.WriteInt(letter.Line + lines + 1);
+    line.Write(",\"reason\":\"");
+    line.Write(RejectReasonKey(letter.Reason));
+    line.Write("\",\"message\":");
+    line.WriteString(letter.Message);
+    if (!letter.Record.empty()) {
+        line.Write(",\"record\":");
+        line.WriteString(letter.Record);
+    }
+    line.Put('}');
+    line.EndRecord();
+
+    const std::string text = line.Take();
+    std::lock_guard<std::mutex> guard(Lock);
+    fwrite(text.data(), 1, text.size(), Out);
+}
+
+void DeadLetterQueue::Flush() {
+    std::lock_guard<std::mutex> guard(Lock);
+    fflush(Out);
+}
@@ -0,0 +1,43 @@
+#ifndef __DEAD_LETTERS_H_
+#define __DEAD_LETTERS_H_
+
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <mutex>
+
+#include "run_stats.h"
+
+// A rejected record.
+struct DeadLetter {
+    // Where the record starts in the input and on which line (counted from 0 like ParserState::LineNum).
+    size_t Offset;
+    int Line;
+    RejectReason Reason;
+    // What was reported for it (see ParseContext::Reject).
+    std::string Message;
+    // Raw text of the record, only when the input is kept in memory. Empty for streams.
+    std::string_view Record;
+};
+
+// Where the rejected records of a run go (--dead-letters), one JSON line each:
+//   {"offset":<byte>,"line":<line, from 1>,"reason":"<RejectReason key>","message":"<error>","record":"<raw text>"}
+// Thread safe, shared by every parse of a run.
+struct DeadLetterQueue {
+    explicit DeadLetterQueue(FILE* out)
+        : Out(out) {}
+
+    DeadLetterQueue(const DeadLetterQueue&) = delete;
+    DeadLetterQueue& operator=(const DeadLetterQueue&) = delete;
+
+    // 'offset' and 'lines' are added to the ones of the letter, for parses of a part of the input.
+    void Write(const DeadLetter& letter, size_t offset = 0, int lines = 0);
+
+    void Flush();
+
+private:
+    FILE* Out;
+    std::mutex Lock;
+};
+
+#endif //__DEAD_LETTERS_H_
@@ -7,85 +7,197 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+
+// A number left out of some text, written in later when what it is relative to is known (see ParserState::LineMarks).
+struct NumberMark {
+    // Where the number goes in the text.
+    size_t Position;
+    long long Value;
+};
 
 // Holds parse state, used for reporting errors.
+// Only offsets are tracked while scanning, the text of the lines is reconstructed from the source when an error is reported.
 struct ParserState {
     // The line number we are currently parsing.
     int LineNum = 0;
 
-    // The contents of the last line we parsed. 
-    std::vector<std::string> LineTexts = { "" };
-    std::string LastMatch = "";
+    // Offsets where the current and the previous line begin.
+    size_t LineStart = 0;
+    size_t PrevLineStart = 0;
+
+    // Offset and length of the last token we matched.
+    size_t LastMatchOffset = 0;
+    size_t LastMatchLength = 0;
+
+    // The input text, when it is kept in memory for the whole parse.
+    const char* Source = nullptr;
+
+    // When reading from a stream there is no source to look back into, 
+    // so only the text of the current and previous line is kept instead.
+    std::string StreamLine;
+    std::string StreamPrevLine;
 
-    // Once we found a \n
-    void CountLine() {
+    // Where errors are reported. Parallel parses point this to a per chunk buffer.
+    std::ostream* Err = &std::cerr;
+
+    // When set, the line numbers of the reports are left out of Err and marked here instead (positions in Err).
+    // A parallel parse of a chunk doesn't know on which line the chunk starts, LineNum counts from its start.
+    std::vector<NumberMark>* LineMarks = nullptr;
+
+    // Once we found a \n, 'offset' is where the next line begins.
+    void CountLine(size_t offset) {
         ++LineNum;
-        LineTexts.push_back(std::string());
+        PrevLineStart = LineStart;
+        LineStart = offset;
+        if (!Source) {
+            StreamPrevLine.swap(StreamLine);
+            StreamLine.clear();
+        }
     }
 
     // Called always when there is a flex rule match
-    void Match(char* text) {
-        LineTexts[LineNum].append(text);
-        LastMatch = text;
+    void Match(const char* text, size_t length, size_t offset) {
+        LastMatchOffset = offset;
+        LastMatchLength = length;
+        if (!Source) {
+            StreamLine.append(text, length);
+        }
+    }
+
+    // The current line up to (and including) the last match.
+    std::string_view CurrentLine() const {
+        if (!Source) {
+            return StreamLine;
+        }
+        const size_t end = LastMatchOffset + LastMatchLength;
+        return end > LineStart ? std::string_view(Source + LineStart, end - LineStart) : std::string_view();
+    }
+
+    // The whole previous line without its line break.
+    std::string_view PreviousLine() const {
+        if (!Source) {
+            return StreamPrevLine;
+        }
+        std::string_view line(Source + PrevLineStart, LineStart - PrevLineStart);
+        while (line.length() && (line.back() == '\n' || line.back() == '\r')) {
+            line.remove_suffix(1);
+        }
+        return line;
     }
 
     // Prints a "pretty" formatted line
-    int PrintLine(int Index) const {
-        if (Index < 0) {
+    int PrintLine(int Index, std::string_view Text) const {
+        // With LineMarks a chunk past the start of the source has lines before it.
+        if (Index < 0 && !(LineMarks && Source && LineStart > 0)) {
             return 0;
         }
-        std::cerr << "Line " << std::setw(3) << Index << ": " << LineTexts[Index] << "\n";
-        return LineTexts[Index].length();
+        *Err << "Line ";
+        if (LineMarks) {
+            LineMarks->push_back(NumberMark { (size_t)Err->tellp(), Index });
+        }
+        else {
+            *Err << std::setw(3) << Index;
+        }
+        *Err << ": " << Text << "\n";
+        return Text.length();
     }
 
     // Prints a "pretty" fromatted error including the previous line for context.
-    void ReportErrorAtOffset(int offset) const {
-        std::string error_token = "";
+    void ReportErrorAtOffset(size_t offset) const {
+        std::string_view error_token = "";
         
-        const std::string& last_line = LineTexts[LineNum];
+        const std::string_view last_line = CurrentLine();
         const size_t slice_start = last_line.length() > offset ? last_line.length() - offset : 0;
        
        if (last_line.length() > 0) {
            error_token = last_line.substr(slice_start);
        }
 
-        std::cerr << "Failed to parse: '" << error_token << "'\n";
-        PrintLine(LineNum - 1);
-        const int error_loc = PrintLine(LineNum) - offset;
+        *Err << "Failed to parse: '" << error_token << "'\n";
+        PrintLine(LineNum - 1, PreviousLine());
+        const int error_loc = PrintLine(LineNum, last_line) - (int)offset;
         
-        std::cerr << std::string(9, '>') << std::string(std::max(error_loc, 0), '-') 
-                << " " << std::string(LastMatch.length(), '^') << "\n";
+        *Err << std::string(9, '>') << std::string(std::max(error_loc, 0), '-') 
+                << " " << std::string(LastMatchLength, '^') << "\n";
     }
 
     void ReportLastTokenError() const {
-        if (LastMatch.size()) {
-            ReportErrorAtOffset(LastMatch.size());
+        if (LastMatchLength) {
+            ReportErrorAtOffset(LastMatchLength);
         }
     }
 
     void ReportError(const std::string& reason) const {
         ReportLastTokenError();
-        std::cerr << "Reason: " << reason << "\n";
+        *Err << "Reason: " << reason << "\n";
     }
 };
 
 
 
-// Due to the way each file from flex & bison partialy includes one another we make this extern and define it in the .l
-extern ParserState parse;
-
 namespace util {
 
-static char* MakeString(char* from) {
-    return strndup(from + 1, strlen(from) - 2);
+// Number conversions of the lexers. std::from_chars is exact (correctly rounded) and does not consult the locale
+// like atof/strtod do. The text doesn't need to be NUL terminated.
+
+// +-HUGE_VAL or +-0 for a {float} token that is out of the range of a double.
+inline double OutOfRange(const char* from, size_t length) {
+    const char* const end = from + length;
+    const bool negative = from < end && *from == '-';
+    const char* at = from + negative;
+
+    // Decimal exponent of the leading digit, without the exponent part. Zeros ahead of it only count after the point.
+    long long scale = -1;
+    bool leading = false;
+    bool fraction = false;
+    for (; at < end && *at != 'e' && *at != 'E'; ++at) {
+        if (*at == '.') {
+            fraction = true;
+        }
+        else if (!leading && *at == '0') {
+            scale -= fraction;
+        }
+        else {
+            leading = true;
+            scale += !fraction;
+        }
+    }
+
+    long long exponent = 0;
+    if (at < end) {
+        const bool down = at + 1 < end && at[1] == '-';
+        at += 1 + (at + 1 < end && (at[1] == '-' || at[1] == '+'));
+        if (std::from_chars(at, end, exponent).ec != std::errc()) {
+            // Out of range itself, far enough either way.
+            exponent = 1LL << 32;
+        }
+        exponent = down ? -exponent : exponent;
+    }
+
+    const double magnitude = scale + exponent >= 0 ? HUGE_VAL : 0.0;
+    return negative ? -magnitude : magnitude;
 }
 
-static float MakeFloat(char* from) {
-    return atof(from);
+// Reads a {float} token (or an integer too big for MakeInt).
+inline double MakeDouble(const char* from, size_t length) {
+    double value = 0;
+    const std::from_chars_result result = std::from_chars(from, from + length, value);
+    if (result.ec == std::errc::result_out_of_range) {
+        // The value is left untouched. Like strtod it overflows to +-HUGE_VAL and underflows to +-0, which one
+        // depends on the decimal exponent of the leading digit.
+        return OutOfRange(from, length);
+    }
+    return value;
 }
 
-static long long MakeInt(char* from) {
-    return atoll(from);
+// Reads an integer token. False if it does not fit in 64 bits.
+inline bool MakeInt(const char* from, size_t length, long long& value) {
+    const std::from_chars_result result = std::from_chars(from, from + length, value);
+    return result.ec == std::errc();
 }
 
 } // util
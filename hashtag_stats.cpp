@@ -0,0 +1,259 @@
+#include "hashtag_stats.h"
+#include "json_classes.h"
+#include "tape.h"
+#include "id_set.h"
+#include "twitter_date.h"
+
+#include <atomic>
+#include <algorithm>
+
+// Sketch widths (counters per row), the whole stream gets more room than a single bucket.
+static const size_t TotalSketchWidth = 1 << 16;
+static const size_t BucketSketchWidth = 1 << 12;
+
+static std::atomic<bool> DumpRequested{false};
+
+HashtagStats::CountMinSketch::CountMinSketch(size_t width)
+    : Counters(width * Depth, 0)
+    , Width(width) {}
+
+uint32_t HashtagStats::CountMinSketch::Add(uint64_t hash) {
+    // Row i uses h1 + i * h2, two hashes are enough for every row.
+    const uint64_t h1 = hash;
+    const uint64_t h2 = IdSet::Hash(hash) | 1;
+    uint32_t* cells[Depth];
+    uint32_t estimate = UINT32_MAX;
+    for (int i = 0; i < Depth; ++i) {
+        cells[i] = &Counters[i * Width + ((h1 + i * h2) & (Width - 1))];
+        estimate = std::min(estimate, *cells[i]);
+    }
+    if (estimate == UINT32_MAX) {
+        return estimate;
+    }
+    ++estimate;
+    for (uint32_t* cell : cells) {
+        *cell = std::max(*cell, estimate);
+    }
+    return estimate;
+}
+
+void HashtagStats::TopK::Add(const std::string& tag, uint64_t hash) {
+    const uint32_t estimate = Sketch.Add(hash);
+
+    auto found = Candidates.find(tag);
+    if (found != Candidates.end()) {
+        // Already a candidate, its count only grew so it can only move away from the top.
+        found->second.Count = estimate;
+        SiftDown(found->second.Position);
+        return;
+    }
+    if (Heap.size() < Capacity) {
+        auto* entry = &*Candidates.emplace(tag, Candidate { estimate, Heap.size() }).first;
+        Heap.push_back(entry);
+        SiftUp(Heap.size() - 1);
+        return;
+    }
+    if (Capacity == 0 || estimate <= Heap[0]->second.Count) {
+        return;
+    }
+    // Replaces the weakest candidate.
+    Candidates.erase(Candidates.find(Heap[0]->first));
+    auto* entry = &*Candidates.emplace(tag, Candidate { estimate, 0 }).first;
+    Place(0, entry);
+    SiftDown(0);
+}
+
+void HashtagStats::TopK::Place(size_t position, std::pair<const std::string, Candidate>* entry) {
+    Heap[position] = entry;
+    entry->second.Position = position;
+}
+
+void HashtagStats::TopK::SiftUp(size_t position) {
+    auto* entry = Heap[position];
+    while (position > 0) {
+        const size_t parent = (position - 1) / 2;
+        if (Heap[parent]->second.Count <= entry->second.Count) {
+            break;
+        }
+        Place(position, Heap[parent]);
+        position = parent;
+    }
+    Place(position, entry);
+}
+
+void HashtagStats::TopK::SiftDown(size_t position) {
+    auto* entry = Heap[position];
+    for (;;) {
+        size_t child = position * 2 + 1;
+        if (child >= Heap.size()) {
+            break;
+        }
+        if (child + 1 < Heap.size() && Heap[child + 1]->second.Count < Heap[child]->second.Count) {
+            ++child;
+        }
+        if (entry->second.Count <= Heap[child]->second.Count) {
+            break;
+        }
+        Place(position, Heap[child]);
+        position = child;
+    }
+    Place(position, entry);
+}
+
+void HashtagStats::TopK::Write(FILE* out) const {
+    std::vector<const std::pair<const std::string, Candidate>*> sorted(Heap.begin(), Heap.end());
+    std::sort(sorted.begin(), sorted.end(), [](auto* a, auto* b) {
+        return a->second.Count != b->second.Count ? a->second.Count > b->second.Count : a->first < b->first;
+    });
+    fputc('[', out);
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        // Tags are only [a-z0-9_] so they need no escaping.
+        fprintf(out, "%s{\"tag\":\"%s\",\"count\":%u}", i ? "," : "", sorted[i]->first.c_str(), sorted[i]->second.Count);
+    }
+    fputc(']', out);
+}
+
+HashtagStats::HashtagStats(size_t topK, long long bucketSeconds)
+    : Total(topK, TotalSketchWidth)
+    , BucketSeconds(bucketSeconds) {}
+
+void HashtagStats::RequestDump() {
+    DumpRequested.store(true, std::memory_order_relaxed);
+}
+
+// The text the hashtags of a tweet are counted from.
+static const JString* HashtagText(const JObject& tweet) {
+    const JObject* extended = tweet.ExMembers.ExTweet;
+    if (extended && extended->ExMembers.FullText) {
+        return extended->ExMembers.FullText;
+    }
+    return tweet.Members.Text;
+}
+
+// Same for a tweet on a tape, the grammar keeps every "text" and "full_text" as a Text.
+static const JString* HashtagText(const TapeSpecialMembers& tweet) {
+    if (tweet.ExTweet) {
+        const TapeValue fullText = TapeSpecialMembers(tweet.ExTweet.AsObject()).FullText;
+        if (fullText.Type() == TapeType::Text) {
+            return fullText.AsText();
+        }
+    }
+    return tweet.Text.AsText();
+}
+
+void HashtagStats::AddRecord(const JObject& tweet) {
+    AddText(*HashtagText(tweet), tweet.Members.CreatedAt->Text);
+}
+
+void HashtagStats::AddRecord(const TapeObject& tweet) {
+    const TapeSpecialMembers members(tweet);
+    AddText(*HashtagText(members), members.CreatedAt.AsString());
+}
+
+HashtagStats::Record HashtagStats::Collect(const JObject& tweet) const {
+    return CollectText(*HashtagText(tweet), tweet.Members.CreatedAt->Text);
+}
+
+HashtagStats::Record HashtagStats::Collect(const TapeObject& tweet) const {
+    const TapeSpecialMembers members(tweet);
+    return CollectText(*HashtagText(members), members.CreatedAt.AsString());
+}
+
+void HashtagStats::AddText(const JString& text, std::string_view createdAt) {
+    std::lock_guard<std::mutex> guard(Lock);
+    ++Records;
+
+    TopK* bucket = nullptr;
+    long long time;
+    if (BucketSeconds > 0 && !text.Hashtags.empty() && ParseCreatedAt(createdAt, time)) {
+        bucket = BucketLocked(time);
+    }
+    for (const HashTagData& hashtag : text.Hashtags) {
+        AddTagLocked(hashtag.Tag, bucket);
+    }
+    EndRecordLocked();
+}
+
+HashtagStats::Record HashtagStats::CollectText(const JString& text, std::string_view createdAt) const {
+    Record record;
+    if (text.Hashtags.empty()) {
+        return record;
+    }
+    for (const HashTagData& hashtag : text.Hashtags) {
+        record.Tags.emplace_back(hashtag.Tag);
+    }
+    record.HasTime = BucketSeconds > 0 && ParseCreatedAt(createdAt, record.Time);
+    return record;
+}
+
+void HashtagStats::Add(const Record& record) {
+    std::lock_guard<std::mutex> guard(Lock);
+    ++Records;
+
+    TopK* bucket = record.HasTime ? BucketLocked(record.Time) : nullptr;
+    for (const std::string& tag : record.Tags) {
+        AddTagLocked(tag, bucket);
+    }
+    EndRecordLocked();
+}
+
+HashtagStats::TopK* HashtagStats::BucketLocked(long long time) {
+    const long long start = (time / BucketSeconds - (time % BucketSeconds < 0)) * BucketSeconds;
+    auto found = Buckets.find(start);
+    if (found != Buckets.end()) {
+        return &found->second;
+    }
+    if (Buckets.size() >= MaxBuckets) {
+        if (start < Buckets.begin()->first) {
+            return nullptr;
+        }
+        Buckets.erase(Buckets.begin());
+        ++DroppedBuckets;
+    }
+    return &Buckets.try_emplace(start, Total.Capacity, BucketSketchWidth).first->second;
+}
+
+void HashtagStats::AddTagLocked(std::string_view tag, TopK* bucket) {
+    Folded.assign(tag.data(), tag.length());
+    for (char& c : Folded) {
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+    }
+    const uint64_t hash = std::hash<std::string>()(Folded);
+    Total.Add(Folded, hash);
+    if (bucket) {
+        bucket->Add(Folded, hash);
+    }
+    ++Tags;
+}
+
+void HashtagStats::EndRecordLocked() {
+    if (DumpRequested.load(std::memory_order_relaxed) && DumpRequested.exchange(false)) {
+        DumpLocked(DumpTo);
+    }
+}
+
+void HashtagStats::Dump(FILE* out) {
+    std::lock_guard<std::mutex> guard(Lock);
+    DumpLocked(out);
+}
+
+void HashtagStats::DumpLocked(FILE* out) {
+    fprintf(out, "{\"hashtags\":{\"records\":%llu,\"tags\":%llu,\"top\":", Records, Tags);
+    Total.Write(out);
+    if (BucketSeconds > 0) {
+        fprintf(out, ",\"bucket_seconds\":%lld,\"dropped_buckets\":%llu,\"buckets\":[", BucketSeconds,
+                DroppedBuckets);
+        bool first = true;
+        for (const auto& [start, bucket] : Buckets) {
+            fprintf(out, "%s{\"start\":%lld,\"top\":", first ? "" : ",", start);
+            bucket.Write(out);
+            fputc('}', out);
+            first = false;
+        }
+        fputc(']', out);
+    }
+    fputs("}}\n", out);
+    fflush(out);
+}
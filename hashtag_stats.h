@@ -0,0 +1,133 @@
+#ifndef __HASHTAG_STATS_H_
+#define __HASHTAG_STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+
+struct JObject;
+struct JString;
+struct TapeObject;
+
+// Hashtag frequencies of the accepted records of a run.
+//
+// Every tag goes to a count-min sketch, so memory doesn't grow with the number of distinct tags the stream has,
+// and the tags with the highest estimates are kept in a top-K min-heap (heavy hitters). Counts are estimates
+// that can only be too high, by at most a small share of all the hashtags seen.
+// With 'bucketSeconds' the same is also kept per bucket of created_at time (with a smaller sketch), for the
+// newest MaxBuckets buckets only: older ones are dropped as newer ones come, so that a stream spanning a long
+// time (or a few records with created_at far apart) doesn't use memory without bound.
+//
+// Tags are counted case insensitively (lowercased) like Twitter does. Extended tweets count the tags of their
+// full_text, other tweets those of their text.
+//
+// Thread safe, shared by every parse of a run (a single lock taken once per record).
+struct HashtagStats {
+    // Most buckets kept at a time.
+    static const size_t MaxBuckets = 256;
+
+    HashtagStats(size_t topK, long long bucketSeconds);
+
+    HashtagStats(const HashtagStats&) = delete;
+    HashtagStats& operator=(const HashtagStats&) = delete;
+
+    // Counts the hashtags of a valid outer object.
+    // Also writes the dump asked for by RequestDump, if any, to 'DumpTo'.
+    void AddRecord(const JObject& tweet);
+    void AddRecord(const TapeObject& tweet);
+
+    // The hashtags of a record, collected to be counted later.
+    struct Record {
+        std::vector<std::string> Tags;
+        // created_at, only with buckets.
+        bool HasTime = false;
+        long long Time = 0;
+    };
+
+    // Collects the hashtags of a valid outer object without counting them.
+    Record Collect(const JObject& tweet) const;
+    Record Collect(const TapeObject& tweet) const;
+    // Counts collected hashtags, same as AddRecord of their record.
+    void Add(const Record& record);
+
+    // Writes the current top tags as a single JSON line.
+    void Dump(FILE* out);
+
+    // Asks for a dump on the next record. Async signal safe (eg: from a SIGUSR1 handler).
+    static void RequestDump();
+
+    // Where requested dumps go.
+    FILE* DumpTo = stderr;
+
+private:
+    // Counters of Depth rows, a tag increments one counter per row and its estimate is the smallest of them.
+    struct CountMinSketch {
+        static const int Depth = 4;
+
+        std::vector<uint32_t> Counters;
+        size_t Width;
+
+        explicit CountMinSketch(size_t width);
+
+        // Conservative update: only the counters at the current estimate grow. Returns the new estimate.
+        uint32_t Add(uint64_t hash);
+    };
+
+    struct Candidate {
+        uint32_t Count;
+        size_t Position;
+    };
+
+    struct TopK {
+        CountMinSketch Sketch;
+        size_t Capacity;
+        // Tags currently in the heap, the map nodes don't move so the heap points to them.
+        std::unordered_map<std::string, Candidate> Candidates;
+        // Min-heap by Count, the weakest candidate is at the top.
+        std::vector<std::pair<const std::string, Candidate>*> Heap;
+
+        TopK(size_t capacity, size_t sketchWidth)
+            : Sketch(sketchWidth)
+            , Capacity(capacity) {}
+
+        void Add(const std::string& tag, uint64_t hash);
+        void Write(FILE* out) const;
+
+    private:
+        void SiftUp(size_t position);
+        void SiftDown(size_t position);
+        void Place(size_t position, std::pair<const std::string, Candidate>* entry);
+    };
+
+    // AddRecord and Collect of the text the hashtags are counted from and the created_at of its tweet.
+    void AddText(const JString& text, std::string_view createdAt);
+    Record CollectText(const JString& text, std::string_view createdAt) const;
+
+    // The bucket of 'time', created if needed. Null if it is older than every bucket kept when there are
+    // MaxBuckets of them.
+    TopK* BucketLocked(long long time);
+    void AddTagLocked(std::string_view tag, TopK* bucket);
+    void EndRecordLocked();
+    void DumpLocked(FILE* out);
+
+    std::mutex Lock;
+    TopK Total;
+    long long BucketSeconds;
+    // By bucket start time.
+    std::map<long long, TopK> Buckets;
+    // Buckets dropped to keep MaxBuckets.
+    unsigned long long DroppedBuckets = 0;
+
+    unsigned long long Records = 0;
+    unsigned long long Tags = 0;
+
+    // Lowercased copy of the tag being counted.
+    std::string Folded;
+};
+
+#endif //__HASHTAG_STATS_H_
@@ -0,0 +1,164 @@
+#ifndef __ID_SET_H_
+#define __ID_SET_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <cstddef>
+#include <vector>
+
+// Open addressing set of 64 bit ids (linear probing, power of two capacity, at most 3/4 full).
+// Ids are stored inline in one flat array: 8 bytes per slot and usually a single cache miss per lookup,
+// instead of a heap node per id like the std sets.
+//
+// The slot array is either owned or adopted from somewhere else (a snapshot mapping, see JsonDB::Open).
+// The layout only depends on Hash so an adopted table is used as is, it moves to owned memory when it has to grow.
+struct IdSet {
+    static const size_t MinCapacity = 64;
+
+    // Mixes all the bits of an id, sequential ids are common and would cluster otherwise.
+    static uint64_t Hash(uint64_t id) {
+        id ^= id >> 33;
+        id *= 0xff51afd7ed558ccdULL;
+        id ^= id >> 33;
+        id *= 0xc4ceb9fe1a85ec53ULL;
+        id ^= id >> 33;
+        return id;
+    }
+
+    IdSet() {}
+
+    IdSet(const IdSet&) = delete;
+    IdSet& operator=(const IdSet&) = delete;
+
+    // Returns false if the id was already in the set.
+    bool Insert(uint64_t id) {
+        // 0 marks the empty slots.
+        if (id == 0) {
+            if (HasZero) {
+                return false;
+            }
+            HasZero = true;
+            ++Count;
+            return true;
+        }
+
+        if ((Count + 1) * 4 > Capacity * 3) {
+            Rehash(Capacity ? Capacity * 2 : MinCapacity);
+        }
+
+        const size_t mask = Capacity - 1;
+        for (size_t i = Hash(id) & mask;; i = (i + 1) & mask) {
+            if (Slots[i] == id) {
+                return false;
+            }
+            if (Slots[i] == 0) {
+                Slots[i] = id;
+                ++Count;
+                return true;
+            }
+        }
+    }
+
+    bool Contains(uint64_t id) const {
+        if (id == 0) {
+            return HasZero;
+        }
+        if (Capacity == 0) {
+            return false;
+        }
+        const size_t mask = Capacity - 1;
+        for (size_t i = Hash(id) & mask;; i = (i + 1) & mask) {
+            if (Slots[i] == id) {
+                return true;
+            }
+            if (Slots[i] == 0) {
+                return false;
+            }
+        }
+    }
+
+    // Removes every id but keeps the table, so a set that is refilled to the same size never reallocates.
+    void Clear() {
+        if (Capacity) {
+            memset(Slots, 0, Capacity * sizeof(uint64_t));
+        }
+        Count = 0;
+        HasZero = false;
+    }
+
+    // Makes room for 'count' ids without rehashing.
+    void Reserve(size_t count) {
+        size_t capacity = MinCapacity;
+        while (capacity * 3 < count * 4) {
+            capacity *= 2;
+        }
+        if (capacity > Capacity) {
+            Rehash(capacity);
+        }
+    }
+
+    // Uses 'slots' (a table written from Data() of a set) without copying it, it must outlive the set or its next growth.
+    // Returns false if it can't be a table of this layout.
+    bool Adopt(uint64_t* slots, size_t capacity, size_t count, bool hasZero) {
+        if (capacity < MinCapacity || (capacity & (capacity - 1)) || count * 4 > capacity * 3) {
+            return false;
+        }
+        Owned.clear();
+        Owned.shrink_to_fit();
+        Slots = slots;
+        Capacity = capacity;
+        Count = count;
+        HasZero = hasZero;
+        return true;
+    }
+
+    const uint64_t* Data() const {
+        return Slots;
+    }
+
+    size_t SlotCount() const {
+        return Capacity;
+    }
+
+    bool ContainsZero() const {
+        return HasZero;
+    }
+
+    size_t Size() const {
+        return Count;
+    }
+
+    size_t MemoryBytes() const {
+        return Capacity * sizeof(uint64_t);
+    }
+
+private:
+    void Rehash(size_t capacity) {
+        std::vector<uint64_t> table(capacity, 0);
+
+        const size_t mask = capacity - 1;
+        for (size_t j = 0; j < Capacity; ++j) {
+            const uint64_t id = Slots[j];
+            if (id == 0) {
+                continue;
+            }
+            size_t i = Hash(id) & mask;
+            while (table[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            table[i] = id;
+        }
+
+        Owned.swap(table);
+        Slots = Owned.data();
+        Capacity = capacity;
+    }
+
+    uint64_t* Slots = nullptr;
+    size_t Capacity = 0;
+    size_t Count = 0;
+    bool HasZero = false;
+    std::vector<uint64_t> Owned;
+};
+
+#endif //__ID_SET_H_
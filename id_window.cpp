@@ -0,0 +1,192 @@
+#include "id_window.h"
+
+#include <algorithm>
+#include <limits>
+
+const long long IdWindow::Stale = std::numeric_limits<long long>::min();
+
+// Bits per cold id, about 1% false positives with 7 bits set in a 512 bit block.
+static const size_t BloomBitsPerId = 10;
+static const int BloomProbes = 7;
+static const size_t BloomBlockWords = 8;
+
+void IdWindow::BloomFilter::Reset(size_t expectedIds) {
+    size_t blocks = 1;
+    while (blocks * BloomBlockWords * 64 < expectedIds * BloomBitsPerId) {
+        blocks *= 2;
+    }
+    if (Blocks.size() == blocks * BloomBlockWords) {
+        std::fill(Blocks.begin(), Blocks.end(), 0);
+    }
+    else {
+        Blocks.assign(blocks * BloomBlockWords, 0);
+    }
+}
+
+void IdWindow::BloomFilter::Add(uint64_t hash) {
+    uint64_t* block = &Blocks[(hash % (Blocks.size() / BloomBlockWords)) * BloomBlockWords];
+    // The upper bits pick the bits inside the block, 9 per probe.
+    uint64_t bits = hash >> 32 | hash << 32;
+    for (int i = 0; i < BloomProbes; ++i, bits >>= 9) {
+        block[(bits >> 6) & 7] |= 1ULL << (bits & 63);
+    }
+}
+
+bool IdWindow::BloomFilter::MayContain(uint64_t hash) const {
+    const uint64_t* block = &Blocks[(hash % (Blocks.size() / BloomBlockWords)) * BloomBlockWords];
+    uint64_t bits = hash >> 32 | hash << 32;
+    for (int i = 0; i < BloomProbes; ++i, bits >>= 9) {
+        if (!(block[(bits >> 6) & 7] & (1ULL << (bits & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Ring position of a bucket index.
+static size_t RingSlot(long long index, long long ring) {
+    const long long slot = index % ring;
+    return slot < 0 ? slot + ring : slot;
+}
+
+IdWindow::IdWindow(long long windowSeconds, int bucketCount, bool useBloom)
+    : BucketSeconds(windowSeconds / bucketCount > 0 ? windowSeconds / bucketCount : 1)
+    , BucketCount(bucketCount)
+    , UseBloom(useBloom) {
+    for (Shard& shard : Shards) {
+        // Two extra buckets: the partial newest one and one for the rounding of the oldest time to its bucket.
+        shard.Buckets = std::vector<Bucket>(BucketCount + 2);
+        for (Bucket& bucket : shard.Buckets) {
+            bucket.Index = Stale;
+        }
+        shard.Newest = Stale;
+        shard.Cold.Reset(0);
+    }
+}
+
+long long IdWindow::BucketIndex(long long time) const {
+    // Floor division, so times before the epoch still land in the right bucket.
+    long long index = time / BucketSeconds;
+    if (time % BucketSeconds < 0) {
+        --index;
+    }
+    return index;
+}
+
+bool IdWindow::MaybeInsert(uint64_t id, long long time) {
+    Shard& shard = Shards[(IdSet::Hash(id) >> 32) % ShardCount];
+    std::lock_guard<std::mutex> guard(shard.Lock);
+    return Insert(shard, id, BucketIndex(time));
+}
+
+bool IdWindow::Contains(uint64_t id, long long time) {
+    const long long index = BucketIndex(time);
+    Shard& shard = Shards[(IdSet::Hash(id) >> 32) % ShardCount];
+    std::lock_guard<std::mutex> guard(shard.Lock);
+    if (shard.Newest == Stale) {
+        return false;
+    }
+    // The buckets Insert would still look at: those Advance would keep for a newer 'index'.
+    const long long newest = std::max(shard.Newest, index);
+    const long long ring = shard.Buckets.size();
+    if (index <= newest - ring) {
+        return false;
+    }
+    if (UseBloom && !shard.Buckets[RingSlot(shard.Newest, ring)].Ids.Contains(id)
+        && !shard.Cold.MayContain(IdSet::Hash(id))) {
+        return false;
+    }
+    for (const Bucket& bucket : shard.Buckets) {
+        if (bucket.Index != Stale && bucket.Index > newest - ring && bucket.Ids.Contains(id)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IdWindow::Insert(Shard& shard, uint64_t id, long long index) {
+    const long long ring = shard.Buckets.size();
+    if (shard.Newest == Stale || index > shard.Newest) {
+        Advance(shard, index);
+    }
+    else if (index <= shard.Newest - ring) {
+        // Older than anything still kept.
+        return true;
+    }
+
+    const uint64_t hash = IdSet::Hash(id);
+    Bucket& newest = shard.Buckets[RingSlot(shard.Newest, ring)];
+    if (newest.Ids.Contains(id)) {
+        return false;
+    }
+    if (!UseBloom || shard.Cold.MayContain(hash)) {
+        for (Bucket& bucket : shard.Buckets) {
+            if (&bucket != &newest && bucket.Index != Stale && bucket.Ids.Contains(id)) {
+                return false;
+            }
+        }
+    }
+
+    Bucket& target = shard.Buckets[RingSlot(index, ring)];
+    if (target.Index != index) {
+        // A gap in time left this bucket unused (or expired) until now.
+        target.Ids.Clear();
+        target.Index = index;
+    }
+    target.Ids.Insert(id);
+    if (UseBloom && &target != &newest) {
+        shard.Cold.Add(hash);
+    }
+    return true;
+}
+
+void IdWindow::Advance(Shard& shard, long long index) {
+    const long long ring = shard.Buckets.size();
+    size_t coldIds = 0;
+    for (Bucket& bucket : shard.Buckets) {
+        if (bucket.Index != Stale && bucket.Index <= index - ring) {
+            // Expired as a whole.
+            bucket.Ids.Clear();
+            bucket.Index = Stale;
+        }
+        coldIds += bucket.Ids.Size();
+    }
+
+    Bucket& newest = shard.Buckets[RingSlot(index, ring)];
+    if (newest.Index != index) {
+        newest.Ids.Clear();
+        newest.Index = index;
+    }
+    shard.Newest = index;
+
+    if (!UseBloom) {
+        return;
+    }
+    // The previous newest bucket turned cold, summarise every cold bucket again.
+    shard.Cold.Reset(coldIds);
+    for (Bucket& bucket : shard.Buckets) {
+        if (&bucket == &newest || bucket.Index == Stale) {
+            continue;
+        }
+        const uint64_t* slots = bucket.Ids.Data();
+        for (size_t i = 0; i < bucket.Ids.SlotCount(); ++i) {
+            if (slots[i]) {
+                shard.Cold.Add(IdSet::Hash(slots[i]));
+            }
+        }
+        if (bucket.Ids.ContainsZero()) {
+            shard.Cold.Add(IdSet::Hash(0));
+        }
+    }
+}
+
+size_t IdWindow::Size() {
+    size_t total = 0;
+    for (Shard& shard : Shards) {
+        std::lock_guard<std::mutex> guard(shard.Lock);
+        for (Bucket& bucket : shard.Buckets) {
+            total += bucket.Ids.Size();
+        }
+    }
+    return total;
+}
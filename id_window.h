@@ -0,0 +1,77 @@
+#ifndef __ID_WINDOW_H_
+#define __ID_WINDOW_H_
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+
+#include "id_set.h"
+
+// Ids that are only duplicates within a sliding window of time (eg: 72h of created_at).
+//
+// Time is cut in buckets of Window / BucketCount seconds and every bucket keeps its own IdSet.
+// When the newest time moves into a new bucket, the buckets that fell out of the window are cleared
+// and reused as a whole (no per id eviction, no reallocation once warmed up), so memory only depends
+// on how many ids a window holds and not on how long the stream runs.
+// Ids are kept up to two buckets longer than the window.
+//
+// Every bucket but the newest one is 'cold': it only changes for late records. With UseBloom the cold
+// buckets are summarised in one Bloom filter (rebuilt when the buckets rotate), so a new id costs one probe
+// of the newest bucket and one filter check instead of a probe of every bucket.
+//
+// Thread safe, split in shards by id like JsonDB.
+struct IdWindow {
+    IdWindow(long long windowSeconds, int bucketCount, bool useBloom);
+
+    IdWindow(const IdWindow&) = delete;
+    IdWindow& operator=(const IdWindow&) = delete;
+
+    // Returns false if the id was already seen within the window of 'time' (seconds).
+    // Records older than the whole window are accepted without being kept.
+    bool MaybeInsert(uint64_t id, long long time);
+
+    // Whether MaybeInsert would return false, without inserting anything.
+    bool Contains(uint64_t id, long long time);
+
+    // Ids kept right now.
+    size_t Size();
+
+private:
+    static const int ShardCount = 16;
+
+    // Blocked Bloom filter: every id maps to a single 64 byte block so a check is one cache miss.
+    struct BloomFilter {
+        std::vector<uint64_t> Blocks;
+
+        void Reset(size_t expectedIds);
+        void Add(uint64_t hash);
+        bool MayContain(uint64_t hash) const;
+    };
+
+    struct Bucket {
+        // Start of the bucket in BucketSeconds units, Stale if the bucket is unused.
+        long long Index;
+        IdSet Ids;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex Lock;
+        std::vector<Bucket> Buckets;
+        long long Newest;
+        BloomFilter Cold;
+    };
+
+    static const long long Stale;
+
+    // The bucket of 'time', in BucketSeconds units.
+    long long BucketIndex(long long time) const;
+    bool Insert(Shard& shard, uint64_t id, long long index);
+    void Advance(Shard& shard, long long index);
+
+    long long BucketSeconds;
+    int BucketCount;
+    bool UseBloom;
+    Shard Shards[ShardCount];
+};
+
+#endif //__ID_WINDOW_H_
@@ -0,0 +1,375 @@
+#include "ingest.h"
+#include "mapped_file.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// Chunks are big enough to amortize the scanner setup but small enough to balance the workers.
+const size_t ChunkSize = 8 << 20;
+
+// How many chunks per worker may be parsed ahead of the one being written out.
+// This bounds the memory used for buffered output.
+const size_t ChunksAheadPerWorker = 4;
+
+struct Chunk {
+    // [Begin, End) of the file.
+    size_t Begin;
+    size_t End;
+
+    std::string Out;
+    std::ostringstream Err;
+    // The record and line numbers left out of Out / Err, counted from the start of the chunk.
+    std::vector<NumberMark> RecordMarks;
+    std::vector<NumberMark> LineMarks;
+    unsigned long long RecordCount = 0;
+    unsigned long long AcceptedCount = 0;
+    // Line breaks in the chunk, the lines of its dead letters are counted from its start (offsets are not).
+    int Lines = 0;
+    std::vector<DeadLetter> DeadLetters;
+    ColumnBatch Columns;
+    // The ids of the accepted records, and their hashtags, in input order.
+    std::vector<PendingId> Ids;
+    std::vector<HashtagStats::Record> Hashtags;
+    // Every record, where it ends in each of the outputs above, and the ids it looked up.
+    std::vector<KeptRecord> Records;
+    std::vector<IdLookup> Lookups;
+    // Counters of the parse, not added to the run totals before the chunk is written out.
+    ParseStats* Stats = nullptr;
+    bool Failed = false;
+    bool Done = false;
+
+    Chunk(size_t begin, size_t end)
+        : Begin(begin)
+        , End(end) {}
+};
+
+// Splits the data in pieces of about ChunkSize, each one ending right after a '\n' (or at the end of the data).
+std::vector<std::unique_ptr<Chunk>> SplitChunks(const char* data, size_t length) {
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    size_t begin = 0;
+
+    while (begin < length) {
+        size_t split = begin + ChunkSize < length ? begin + ChunkSize : length;
+        if (split < length) {
+            const char* newline = (const char*)memchr(data + split, '\n', length - split);
+            split = newline ? newline - data + 1 : length;
+        }
+        chunks.emplace_back(new Chunk(begin, split));
+        begin = split;
+    }
+    return chunks;
+}
+
+// Parses a chunk. Its ids (and everything that depends on them being accepted in input order) are kept in the
+// chunk, see ResolveRecords.
+void ParseChunk(Chunk& chunk, const MappedFile& file, JsonDB& database, const ParseSettings& settings) {
+    ParseContext ctx(&database, settings, nullptr);
+    ctx.Parse.Err = &chunk.Err;
+    ctx.KeepDeadLetters = true;
+    ctx.KeepColumns = true;
+    ctx.MarkNumbers = true;
+    ctx.KeepIds = true;
+    ctx.KeepHashtags = true;
+
+    chunk.Failed = ParseRange(ctx, file.Data, chunk.Begin, chunk.End) != 0;
+    chunk.Out = ctx.Writer.Take();
+    chunk.RecordMarks = std::move(ctx.RecordMarks);
+    chunk.LineMarks = std::move(ctx.LineMarks);
+    chunk.RecordCount = ctx.RecordCount;
+    chunk.AcceptedCount = ctx.AcceptedCount;
+    chunk.Lines = ctx.Parse.LineNum;
+    chunk.DeadLetters = std::move(ctx.DeadLetters);
+    chunk.Columns = std::move(ctx.Columns);
+    chunk.Ids = std::move(ctx.KeptIds);
+    chunk.Hashtags = std::move(ctx.Hashtags);
+    chunk.Records = std::move(ctx.KeptRecords);
+    chunk.Lookups = std::move(ctx.Lookups);
+    chunk.Stats = ctx.Stats;
+    ctx.Stats = nullptr;
+}
+
+// The outputs of a chunk put together again, from its own and those of the records that were parsed again.
+struct Spliced {
+    std::string Out;
+    std::string Err;
+    std::vector<NumberMark> RecordMarks;
+    std::vector<NumberMark> LineMarks;
+    std::vector<DeadLetter> DeadLetters;
+    ColumnBatch Columns;
+    std::vector<HashtagStats::Record> Hashtags;
+};
+
+// Where the first 'count' records of the chunk end in its outputs. With one more than it has records, where
+// the outputs end ('err' is the text of chunk.Err).
+KeptRecord EndOf(const Chunk& chunk, const std::string& err, size_t count) {
+    if (count == 0) {
+        return KeptRecord {};
+    }
+    if (count <= chunk.Records.size()) {
+        return chunk.Records[count - 1];
+    }
+    return KeptRecord { chunk.End, chunk.Lines, false, RejectReason::SyntaxError, chunk.Out.size(), err.size(),
+                        chunk.RecordMarks.size(), chunk.LineMarks.size(), chunk.DeadLetters.size(),
+                        chunk.Columns.Rows(), chunk.Hashtags.size(), chunk.Ids.size(), chunk.Lookups.size() };
+}
+
+// Appends the outputs of the records [from, end) of the chunk as they are.
+void AppendRecords(Spliced& to, const Chunk& chunk, const std::string& err, size_t from, size_t end) {
+    const KeptRecord first = EndOf(chunk, err, from);
+    const KeptRecord last = EndOf(chunk, err, end);
+
+    for (size_t i = first.RecordMarks; i < last.RecordMarks; ++i) {
+        const NumberMark& mark = chunk.RecordMarks[i];
+        to.RecordMarks.push_back(NumberMark { mark.Position - first.Out + to.Out.size(), mark.Value });
+    }
+    for (size_t i = first.LineMarks; i < last.LineMarks; ++i) {
+        const NumberMark& mark = chunk.LineMarks[i];
+        to.LineMarks.push_back(NumberMark { mark.Position - first.Err + to.Err.size(), mark.Value });
+    }
+    to.Out.append(chunk.Out, first.Out, last.Out - first.Out);
+    to.Err.append(err, first.Err, last.Err - first.Err);
+    to.DeadLetters.insert(to.DeadLetters.end(), chunk.DeadLetters.begin() + first.DeadLetters,
+                          chunk.DeadLetters.begin() + last.DeadLetters);
+    to.Columns.Append(chunk.Columns, first.Columns, last.Columns - first.Columns);
+    to.Hashtags.insert(to.Hashtags.end(), chunk.Hashtags.begin() + first.Hashtags,
+                       chunk.Hashtags.begin() + last.Hashtags);
+}
+
+// Parses the record 'index' of the chunk again, on its own and against the ids of every record before it in
+// the input, and appends its outputs. Its ids go to the database if it is accepted.
+void ReparseRecord(Spliced& to, Chunk& chunk, size_t index, const MappedFile& file, JsonDB& database,
+                   const ParseSettings& settings) {
+    const KeptRecord& record = chunk.Records[index];
+    // The counters of the chunk have the record already, only its verdict is moved below.
+    ParseSettings single = settings;
+    single.Stats = nullptr;
+    std::ostringstream err;
+    ParseContext ctx(&database, single, nullptr);
+    ctx.Parse.Err = &err;
+    ctx.KeepDeadLetters = true;
+    ctx.KeepColumns = true;
+    ctx.MarkNumbers = true;
+    ctx.KeepHashtags = true;
+    ctx.SingleRecord = true;
+
+    if (ParseRange(ctx, file.Data, record.Begin, chunk.End) != 0) {
+        chunk.Failed = true;
+    }
+    const std::string out = ctx.Writer.Take();
+    const std::string errors = err.str();
+    // Its record and line numbers count from the record, they are made relative to the chunk.
+    for (const NumberMark& mark : ctx.RecordMarks) {
+        to.RecordMarks.push_back(NumberMark { mark.Position + to.Out.size(), mark.Value + (long long)index });
+    }
+    for (const NumberMark& mark : ctx.LineMarks) {
+        to.LineMarks.push_back(NumberMark { mark.Position + to.Err.size(), mark.Value + record.Line });
+    }
+    to.Out += out;
+    to.Err += errors;
+    for (DeadLetter& letter : ctx.DeadLetters) {
+        letter.Line += record.Line;
+        to.DeadLetters.push_back(std::move(letter));
+    }
+    to.Columns.Append(ctx.Columns, 0, ctx.Columns.Rows());
+    for (HashtagStats::Record& hashtags : ctx.Hashtags) {
+        to.Hashtags.push_back(std::move(hashtags));
+    }
+
+    const bool accepted = ctx.AcceptedCount > 0;
+    if (accepted != record.Accepted) {
+        chunk.AcceptedCount += accepted ? 1 : -1;
+    }
+    if (chunk.Stats) {
+        if (record.Accepted) {
+            chunk.Stats->Accepted.Remove();
+        }
+        else {
+            chunk.Stats->Rejected[(int)record.Reason].Remove();
+        }
+        if (accepted) {
+            chunk.Stats->Accepted.Add();
+        }
+        else {
+            chunk.Stats->Rejected[(int)ctx.LastReason].Add();
+        }
+    }
+}
+
+// Adds the ids of the accepted records of a chunk to the database, in input order.
+// The chunk was checked against the ids of the chunks written out before it started, and its own. A record
+// that looked up an id which is (or isn't) in the database now, unlike then, would have had another verdict
+// after the records before it: a chunk before this one accepted the id meanwhile, or the record of this chunk
+// that had it is rejected now. Only such records are parsed again, and their outputs replace theirs in the chunk.
+// Only the writer adds ids, the workers just look them up, so nothing gets in between the check and the insert.
+void ResolveRecords(Chunk& chunk, const MappedFile& file, JsonDB& database, const ParseSettings& settings) {
+    // Set up once a record is parsed again, the records before 'copied' are in it then.
+    std::unique_ptr<Spliced> spliced;
+    std::string err;
+    size_t copied = 0;
+
+    size_t lookup = 0;
+    size_t id = 0;
+    for (size_t i = 0; i < chunk.Records.size(); ++i) {
+        const KeptRecord& record = chunk.Records[i];
+        bool same = true;
+        for (; lookup < record.Lookups; ++lookup) {
+            const IdLookup& looked = chunk.Lookups[lookup];
+            const bool found = looked.Id.User ? database.ContainsUserId(looked.Id.UserId)
+                                              : database.ContainsIdStr(looked.Id.IdStr);
+            same = same && found == looked.Found;
+        }
+
+        if (same) {
+            for (; record.Accepted && id < record.Ids; ++id) {
+                if (chunk.Ids[id].User) {
+                    database.MaybeInsertUserId(chunk.Ids[id].UserId);
+                }
+                else {
+                    database.MaybeInsertIdStr(chunk.Ids[id].IdStr);
+                }
+            }
+        }
+        else {
+            if (!spliced) {
+                spliced.reset(new Spliced());
+                err = chunk.Err.str();
+            }
+            AppendRecords(*spliced, chunk, err, copied, i);
+            ReparseRecord(*spliced, chunk, i, file, database, settings);
+            copied = i + 1;
+        }
+        id = record.Ids;
+    }
+    database.FlushJournal();
+
+    if (spliced) {
+        AppendRecords(*spliced, chunk, err, copied, chunk.Records.size() + 1);
+        chunk.Out = std::move(spliced->Out);
+        chunk.Err.str(spliced->Err);
+        chunk.RecordMarks = std::move(spliced->RecordMarks);
+        chunk.LineMarks = std::move(spliced->LineMarks);
+        chunk.DeadLetters = std::move(spliced->DeadLetters);
+        chunk.Columns = std::move(spliced->Columns);
+        chunk.Hashtags = std::move(spliced->Hashtags);
+    }
+}
+
+// Writes 'text' with the numbers of 'marks' put back in, shifted by 'base'. Numbers are padded to 'width'.
+std::string WithNumbers(const std::string& text, const std::vector<NumberMark>& marks, long long base, int width) {
+    if (marks.empty()) {
+        return text;
+    }
+    std::ostringstream out;
+    size_t from = 0;
+    for (const NumberMark& mark : marks) {
+        out.write(text.data() + from, mark.Position - from);
+        out << std::setw(width) << base + mark.Value;
+        from = mark.Position;
+    }
+    out.write(text.data() + from, text.size() - from);
+    return out.str();
+}
+
+} // namespace
+
+IngestStats IngestParallel(const char* path, JsonDB& database, const ParseSettings& settings, int threads,
+                           FILE* out, std::ostream& err) {
+    IngestStats stats;
+
+    MappedFile file;
+    if (!file.Open(path)) {
+        err << "Could not map '" << path << "'.\n";
+        stats.Ok = false;
+        return stats;
+    }
+
+    std::vector<std::unique_ptr<Chunk>> chunks = SplitChunks(file.Data, file.Length);
+
+    std::mutex lock;
+    std::condition_variable changed;
+    size_t next = 0;
+    size_t written = 0;
+    const size_t window = threads * ChunksAheadPerWorker;
+
+    auto worker = [&]() {
+        for (;;) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&]() { return next >= chunks.size() || next < written + window; });
+                if (next >= chunks.size()) {
+                    return;
+                }
+                index = next++;
+            }
+
+            ParseChunk(*chunks[index], file, database, settings);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                chunks[index]->Done = true;
+            }
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    // This thread writes the finished chunks in order and releases them.
+    // A record is a duplicate if an earlier one in the input was accepted with the same id, like with a single
+    // thread. The workers only know about the chunks written out before they started, so the records whose
+    // verdict that may change are parsed again here, against every id before them (see ResolveRecords).
+    int lines = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]() { return chunks[i]->Done; });
+        }
+
+        Chunk& chunk = *chunks[i];
+        ResolveRecords(chunk, file, database, settings);
+        if (settings.Stats) {
+            settings.Stats->Detach(chunk.Stats);
+        }
+        if (settings.Hashtags) {
+            for (const HashtagStats::Record& record : chunk.Hashtags) {
+                settings.Hashtags->Add(record);
+            }
+        }
+
+        const std::string text = WithNumbers(chunk.Out, chunk.RecordMarks, stats.RecordCount, 0);
+        fwrite(text.data(), 1, text.size(), out);
+        err << WithNumbers(chunk.Err.str(), chunk.LineMarks, lines, 3);
+        for (const DeadLetter& letter : chunk.DeadLetters) {
+            settings.DeadLetters->Write(letter, 0, lines);
+        }
+        stats.RecordCount += chunk.RecordCount;
+        stats.AcceptedCount += chunk.AcceptedCount;
+        stats.Ok = stats.Ok && !chunk.Failed;
+        lines += chunk.Lines;
+        if (settings.Columnar) {
+            settings.Columnar->Add(chunk.Columns);
+        }
+
+        chunk = Chunk(chunk.Begin, chunk.End); // Releases everything the chunk holds.
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            written = i + 1;
+        }
+        changed.notify_all();
+    }
+
+    for (std::thread& t : workers) {
+        t.join();
+    }
+    return stats;
+}
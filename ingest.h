@@ -0,0 +1,23 @@
+#ifndef __INGEST_H_
+#define __INGEST_H_
+
+#include "parse_context.h"
+
+// Totals of an ingestion run.
+struct IngestStats {
+    unsigned long long RecordCount = 0;
+    unsigned long long AcceptedCount = 0;
+    // False if the file could not be read or any chunk stopped on a parse error.
+    bool Ok = true;
+};
+
+// Parses a newline delimited file on 'threads' workers.
+// The file is split in chunks ending at line boundaries, so records must not span multiple lines.
+// Every chunk is parsed with its own ParseContext but all of them share 'database', and the output
+// (and dead letters, columns, hashtags) of the chunks is written to 'out' / 'err' in input order.
+// Ids are added to 'database' in input order too, so the verdicts are the same as with a single thread.
+// Not for a windowed database, whose verdicts depend on the order the ids arrive in.
+IngestStats IngestParallel(const char* path, JsonDB& database, const ParseSettings& settings, int threads,
+                           FILE* out, std::ostream& err);
+
+#endif //__INGEST_H_
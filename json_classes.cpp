@@ -1,243 +1,343 @@
 #include "json_classes.h"
-#include <ostream>
-#include <iomanip>
-#include <codecvt>
+#include "simd_util.h"
+#include "utf8.h"
 #include <algorithm>
 
-void Indent(std::ostream& os, int num) {
-    os << std::string(num * 2, ' ');
-}
-
-bool JsonDB::MaybeInsertIdStr(const char* data) {
-    auto result = IdStrs.insert(std::string(data));
-    // return if insert actually happened
-    return result.second;
-}
-
-bool JsonDB::MaybeInsertUserId(long long id) {
-    auto result = UserIds.insert(id);
-    return result.second;
-}
-
-std::ostream& JValue::Print(std::ostream& os, int indent) const {
+void JValue::Print(JsonWriter& out, int indent) const {
     switch(Type) {
         case JValueType::Object:
-            Data.ObjectData->Print(os, indent);
+            Data.ObjectData->Print(out, indent);
             break;
         case JValueType::Array:
-            Data.ArrayData->Print(os, indent);
+            Data.ArrayData->Print(out, indent);
             break;
         case JValueType::String:
-            Data.StringData->Print(os);
+            Data.StringData->Print(out);
             break;
         case JValueType::Float:
-            os << Data.FloatData;
+            out.WriteFloat(Data.FloatData);
             break;
         case JValueType::Int:
-            os << Data.IntData;
+            out.WriteInt(Data.IntData);
+            break;
+        case JValueType::BigInt:
+            out.Write(Data.BigIntData.View());
             break;
         case JValueType::Bool:
             if (Data.BoolData) {
-                os << "true";
+                out.Write("true");
             }
             else {
-                os << "false";
+                out.Write("false");
             }
             break;
         case JValueType::NullVal:
-            os << "null";
+            out.Write("null");
             break;
     }
-    return os;
 }
 
-std::ostream& JArray::Print(std::ostream& os, int indent) const {
-    os << "[ "; 
-    for (auto it = Elements.rbegin(); it != Elements.rend(); ++it) {
-        os << "\n"; 
-        Indent(os, indent + 1);
-        (*it)->Print(os, indent + 1);
-        os << ",";
+void JArray::Print(JsonWriter& out, int indent) const {
+    out.Put('[');
+    for (auto it = Elements.begin(); it != Elements.end(); ++it) {
+        if (it != Elements.begin()) {
+            out.Put(',');
+        }
+        out.NewLine(indent + 1);
+        (*it)->Print(out, indent + 1);
+    }
+    if (!Elements.empty()) {
+        out.NewLine(indent);
     }
-    os << "\b \n";
-    Indent(os, indent);
-    os << "]"; 
-    return os;
+    out.Put(']');
 }
 
-std::ostream& JMember::Print(std::ostream& os, int indentation) const {
-    os << "\"" << Name << "\": ";
-    Value->Print(os, indentation);
-    return os;
+void JMember::Print(JsonWriter& out, int indentation) const {
+    // Names are never decoded, the token text is already valid JSON.
+    out.WriteRawString(Name);
+    out.KeySeparator();
+    Value->Print(out, indentation);
 }
 
-std::ostream& JObject::Print(std::ostream& os, int indent) const {
-    os << "{ "; 
-    for (auto it = Memberlist.rbegin(); it != Memberlist.rend(); ++it) {
-        os << "\n"; 
-        Indent(os, indent + 1);
-        (*it)->Print(os, indent + 1);
-        os << ",";
+void JObject::Print(JsonWriter& out, int indent) const {
+    out.Put('{');
+    for (auto it = Memberlist.begin(); it != Memberlist.end(); ++it) {
+        if (it != Memberlist.begin()) {
+            out.Put(',');
+        }
+        out.NewLine(indent + 1);
+        (*it)->Print(out, indent + 1);
+    }
+    if (!Memberlist.empty()) {
+        out.NewLine(indent);
     }
-    os << "\b \n";
-    Indent(os, indent);
-    os << "}"; 
-    return os;
+    out.Put('}');
 }
 
-std::ostream& JJson::Print(std::ostream& os) const {
-    JsonData->Print(os, 0);
-    os << "\n";
-    return os;
-};
+void JJson::Print(JsonWriter& out) const {
+    JsonData->Print(out, 0);
+    out.EndRecord();
+}
+
+void JString::Print(JsonWriter& out) const {
+    out.WriteString(Text);
+}
+
+// --- String decoding -----------------------------------------------------------------------------------------
+// Text is copied in bulk up to the next '\', '%' or '#' (found 16/32 bytes at a time), only those go through the tables.
+
+struct DecodeTables {
+    // Output of a simple escape (\n, \", \\, \/ and anything else the lexer lets through), 0 for \u.
+    char Escape[256];
+    // Output of %2X by X, 0 if it is not one of the decoded ones.
+    char Percent[256];
+    // Value of a hex digit, -1 if it is not one.
+    signed char Hex[256];
+    // Characters that continue a hashtag.
+    bool Tag[256];
+
+    constexpr DecodeTables()
+        : Escape()
+        , Percent()
+        , Hex()
+        , Tag() {
+        for (int c = 0; c < 256; ++c) {
+            Escape[c] = (char)c;
+            Hex[c] = -1;
+            Tag[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+        }
+        Escape[(unsigned char)'n'] = '\n';
+        Escape[(unsigned char)'u'] = 0;
 
-std::ostream& JString::Print(std::ostream& os) const {
-    os << "\"" << Text << "\"";
-    return os;
+        Percent[(unsigned char)'B'] = '+';
+        Percent[(unsigned char)'1'] = '!';
+        Percent[(unsigned char)'0'] = ' ';
+        Percent[(unsigned char)'C'] = ',';
+        Percent[(unsigned char)'6'] = '&';
+
+        for (int c = '0'; c <= '9'; ++c) {
+            Hex[c] = c - '0';
+        }
+        for (int c = 'a'; c <= 'f'; ++c) {
+            Hex[c] = c - 'a' + 10;
+            Hex[c - 'a' + 'A'] = c - 'a' + 10;
+        }
+    }
 };
 
-JString::JString(char* source) {
-    const int sourcelen = strlen(source);
-    
-    Text.reserve(sourcelen);
+static constexpr DecodeTables Decode;
 
-    Length = 0;
-    for (int i = 0; i < sourcelen; ++i) {
-        char c = source[i];
-        
-        if (c == '\\') {
-            // This will never overflow beause we only allow valid strings through flex.
-            char esc = source[i+1];
-
-            switch (esc) {
-                case 'n': {
-                    Text.push_back('\n');
-                    Length++;
-                    i++;
-                    break;
-                }
-                case 'u': {
-                    // we are sure that this will always read the correct number of bytes because we check for this in our lexer.
-                    // explicit type ensures we have enough width and correct representation for the conversion
-                    uint32_t u_code = strtol(&source[i+2], nullptr, 16);
-    
-                    std::wstring_convert<std::codecvt_utf8<char32_t>, char32_t> conv;
-                    std::string utf8str = conv.to_bytes(u_code); // convert our U+(u_code) bytes to the actual 3 bytes of UTF-8 escaped string
-
-                    Text.append(utf8str);
-                    Length++; // Count this as 1 'actual' character
-                    i += 5; // increase by characters read after \ (eg: u2345)
-                    break;
-                }
-                default: {
-                    // All other cases just push the character that was escaped.
-                    Text.push_back(esc);
-                    Length++;
-                    i++;
-                    break;
-                }
+// Value of the 4 hex digits at 'hex', -1 if any of them is not one.
+static int32_t ParseHex4(const char* hex) {
+    const int32_t a = Decode.Hex[(unsigned char)hex[0]];
+    const int32_t b = Decode.Hex[(unsigned char)hex[1]];
+    const int32_t c = Decode.Hex[(unsigned char)hex[2]];
+    const int32_t d = Decode.Hex[(unsigned char)hex[3]];
+    if ((a | b | c | d) < 0) {
+        return -1;
+    }
+    return a << 12 | b << 8 | c << 4 | d;
+}
+
+// Writes the UTF-8 bytes of a code point, returns how many.
+static int EncodeUtf8(uint32_t code, char* out) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xC0 | code >> 6);
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xE0 | code >> 12);
+        out[1] = (char)(0x80 | (code >> 6 & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | code >> 18);
+    out[1] = (char)(0x80 | (code >> 12 & 0x3F));
+    out[2] = (char)(0x80 | (code >> 6 & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// Decodes the \uXXXX escape at 'p' (and the low half after it for surrogate pairs). 
+// Returns the input consumed, 0 if it is not a valid escape.
+static size_t DecodeUnicodeEscape(const char* p, const char* end, char*& out) {
+    static const uint32_t Replacement = 0xFFFD;
+
+    if (end - p < 6) {
+        return 0;
+    }
+    const int32_t code = ParseHex4(p + 2);
+    if (code < 0) {
+        return 0;
+    }
+
+    if (code >= 0xD800 && code <= 0xDBFF) {
+        // High surrogate, only a code point along with the low one that must follow.
+        if (end - p >= 12 && p[6] == '\\' && p[7] == 'u') {
+            const int32_t low = ParseHex4(p + 8);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                out += EncodeUtf8(0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00), out);
+                return 12;
             }
         }
-        else if (c == '%') {
-            // Care here to not go out of bounds, its possible to have "... %\0"
-            // it is assumed that what does not match our 5 special characters gets added as literal text.
-            bool FoundMatch = false;
-            
-            if (source[i+1] == '2') {
-                // source[i+2] is not out of bounds here. (it can be '\0')
-                switch(source[i+2]) {
-                    case 'B': {
-                        Text.push_back('+');
-                        Length++;
-                        i += 2;
-                        FoundMatch = true;
-                        break;
-                    }
-                    case '1': {
-                        Text.push_back('!');
-                        Length++;
-                        i += 2;
-                        FoundMatch = true;
-                        break;
-                    }
-                    case '0': {
-                        Text.push_back(' ');
-                        Length++;
-                        i += 2;
-                        FoundMatch = true;
-                        break;
-                    }
-                    case 'C': {
-                        Text.push_back(',');
-                        Length++;
-                        i += 2;
-                        FoundMatch = true;
-                        break;
-                    }
-                    case '6': {
-                        Text.push_back('&');
-                        Length++;
-                        i += 2;
-                        FoundMatch = true;
-                        break;
-                    }
-                }
-            }
+        out += EncodeUtf8(Replacement, out);
+        return 6;
+    }
+    if (code >= 0xDC00 && code <= 0xDFFF) {
+        // Low surrogate without a high one.
+        out += EncodeUtf8(Replacement, out);
+        return 6;
+    }
 
-            // if no match found just add '%'
-            if (!FoundMatch) {
-                Text.push_back(c);
-                Length++;
-            }
+    out += EncodeUtf8(code, out);
+    return 6;
+}
+
+static const char* FindSpecial(const char* p, const char* end) {
+    return simd::FindAny<'\\', '%', '#'>(p, end);
+}
+
+// Decodes the escape ('\') or percent encoding ('%') at 'p', which is one character of the text.
+// Returns the input consumed.
+static size_t DecodeSequence(const char* p, const char* end, char*& out) {
+    if (*p == '\\' && p + 1 < end) {
+        const char escape = Decode.Escape[(unsigned char)p[1]];
+        size_t consumed = 2;
+        if (escape) {
+            *out++ = escape;
         }
-        else if (c == '#') {
-            // Hashtag begins here.
-            HashTagData hashtag;
-            char *readptr = &source[i+1];
-            while((*readptr >= 'a' && *readptr <= 'z') || // Allow a-z
-                  (*readptr >= 'A' && *readptr <= 'Z') || // Allow A-Z
-                  (*readptr >= '0' && *readptr <= '9') || // Allow 0-9
-                  *readptr == '_')  // Allow underscore
-            {                                           // Everything else stops the hashtag
-                hashtag.Tag.push_back(*readptr);
-                readptr++;
-            }
-            
-            if (hashtag.Tag.length() > 0) {
-                // We have a valid hashtag.
-                // Assumes indices count escaped sequences as 1 character. (eg: "text"="/u2330 #abc" starts at 2)
-                hashtag.Begin = Length; // conatins the '#' param
-                Hashtags.push_back(hashtag);
-            } // the rest of the code works both for empty or non-empty TempHashtag
+        else if (!(consumed = DecodeUnicodeEscape(p, end, out))) {
+            // Not a valid \u, keep the 'u' like any other escaped character.
+            *out++ = p[1];
+            consumed = 2;
+        }
+        return consumed;
+    }
+    if (*p == '%') {
+        // Care here to not go out of bounds, its possible to have "... %" at the end.
+        // What does not match our 5 special characters gets added as literal text.
+        const char decoded = end - p >= 3 && p[1] == '2' ? Decode.Percent[(unsigned char)p[2]] : 0;
+        if (decoded) {
+            *out++ = decoded;
+            return 3;
+        }
+        *out++ = '%';
+        return 1;
+    }
+    // A '\' at the very end, the lexer never lets that through.
+    *out++ = *p;
+    return 1;
+}
+
+size_t DecodeText(TextRef from, char* out) {
+    const char* p = from.Data;
+    const char* const end = from.Data + from.Length;
+    char* const start = out;
+    for (;;) {
+        const char* special = simd::FindAny<'\\', '%'>(p, end);
+        memcpy(out, p, special - p);
+        out += special - p;
+        if (special == end) {
+            return out - start;
+        }
+        p = special + DecodeSequence(special, end, out);
+    }
+}
+
+JString::JString(Arena& arena, TextRef from)
+    : ValidUtf8(true)
+    , Hashtags(arena) {
+    const char* p = from.Data;
+    const char* const end = from.Data + from.Length;
+
+    const char* special = FindSpecial(p, end);
+    if (special == end) {
+        // Nothing to convert, keep pointing to the token.
+        Text = from.View();
+        Length = Utf8Length(from.Data, from.Length, ValidUtf8);
+        ExtractRetweetUser();
+        return;
+    }
+
+    // Decoding never makes the text longer so the source length is enough.
+    char* const text = (char*)arena.Allocate(from.Length + 1, 1);
+    char* out = text;
+    Length = 0;
 
-            Text.push_back('#');
-            Text.append(hashtag.Tag);
+    for (;;) {
+        // Plain run up to the next special character.
+        const size_t run = special - p;
+        // The specials are ASCII so a run never splits a valid sequence.
+        memcpy(out, p, run);
+        out += run;
+        Length += Utf8Length(p, run, ValidUtf8);
+        p = special;
+        if (p == end) {
+            break;
+        }
 
-            Length += hashtag.Tag.length() + 1; // Count unicode formatted characters added to text.
+        if (*p == '#') {
+            // Hashtag begins here, everything that is not a tag character ends it.
+            const char* tag = p + 1;
+            const char* tagEnd = tag;
+            while (tagEnd < end && Decode.Tag[(unsigned char)*tagEnd]) {
+                tagEnd++;
+            }
 
-            i += hashtag.Tag.length(); // Forward by the length of the hashtag
+            *out++ = '#';
+            const size_t taglen = tagEnd - tag;
+            memcpy(out, tag, taglen);
+            if (taglen > 0) {
+                // The tag points to the copy we just made in the text.
+                // Assumes indices count escaped sequences as 1 character. (eg: "text"="/u2330 #abc" starts at 2)
+                HashTagData hashtag;
+                hashtag.Tag = std::string_view(out, taglen);
+                hashtag.Begin = Length; // contains the '#'
+                Hashtags.push_back(hashtag);
+            }
+            out += taglen;
+            Length += taglen + 1;
+            p = tagEnd;
         }
         else {
-            Text.push_back(c);
+            // An escape or a percent encoding, counts as 1 'actual' character.
+            p += DecodeSequence(p, end, out);
             Length++;
         }
+
+        special = FindSpecial(p, end);
     }
+    *out = '\0';
+    Text = std::string_view(text, out - text);
 
+    ExtractRetweetUser();
+}
+
+void JString::ExtractRetweetUser() {
     // finally extract RT @user from the string if exists
-    if (source[0] == 'R' &&
-        source[1] == 'T' &&
-        source[2] == ' ' &&
-        source[3] == '@') 
+    // (the decoded text starts the same way as the source since none of these characters are escaped)
+    if (Text.length() >= 4 &&
+        Text[0] == 'R' &&
+        Text[1] == 'T' &&
+        Text[2] == ' ' &&
+        Text[3] == '@') 
     {
-        char *readptr = &source[4];
-        while(  (*readptr > 'a' && *readptr < 'z') || // Allow a-z
+        const char *readptr = &Text[4];
+        const char *endptr = Text.data() + Text.length();
+        while(readptr < endptr && (
+                (*readptr > 'a' && *readptr < 'z') || // Allow a-z
                 (*readptr > 'A' && *readptr < 'Z') || // Allow A-Z
                 (*readptr > '0' && *readptr < '9') || // Allow 0-9
-                 *readptr == '_')  // Allow underscore
+                 *readptr == '_'))  // Allow underscore
         {
-            RetweetUser.push_back(*readptr);
             readptr++;
         }
+        RetweetUser = std::string_view(&Text[4], readptr - &Text[4]);
     }
 }
 
@@ -249,40 +349,58 @@ void JObject::AddMember(JMember* member) {
     // When adding a member if it is special we populate the specific Object Field with its data.
     // the final (simplified) JObject outline looks something like this after we are done adding members.
     // JObject 
-    //    Members[]           - A reversed list with all the members (used for printing output)
+    //    Members[]           - A list with all the members in source order (used for printing output)
     //    ...
     //    IdStr = nullptr     - field 'IdStr' is not present in this object
     //    Text = JString*     - value of 'text' json field
     //    User = JObject*     - value of 'user' json field
     //    
     Memberlist.push_back(member);
-    switch(member->SpecialType) {
-        case JSpecialMember::IdStr:         Members.IdStr       = member->Value->Data.StringData; break;
-        case JSpecialMember::Text:          Members.Text        = member->Value->Data.StringData; break;
-        case JSpecialMember::CreatedAt:     Members.CreatedAt   = member->Value->Data.StringData; break;
-        case JSpecialMember::User:          Members.User        = member->Value->Data.ObjectData; break;
-        case JSpecialMember::UName:         Members.UName       = member->Value->Data.StringData; break;
-        case JSpecialMember::UScreenName:   Members.UScreenName = member->Value->Data.StringData; break;
-        case JSpecialMember::ULocation:     Members.ULocation   = member->Value->Data.StringData; break;
-        case JSpecialMember::UId:           Members.UId         = &member->Value->Data.IntData; break;
-        case JSpecialMember::TweetObj:      Members.TweetObj    = member->Value->Data.ObjectData; break;
-        default:
-            SwitchOnExMember(member);
-    }
+    SetSpecialMember(member);
+}
+
+// The part of a value each schema Kind keeps, null when the value is of another type.
+static JString* StringSlot(JValue* value) {
+    return value->Type == JValueType::String ? value->Data.StringData : nullptr;
 }
 
-void JObject::SwitchOnExMember(JMember* member) {
+static long long* IntSlot(JValue* value) {
+    return value->Type == JValueType::Int ? &value->Data.IntData : nullptr;
+}
+
+static bool* BoolSlot(JValue* value) {
+    return value->Type == JValueType::Bool ? &value->Data.BoolData : nullptr;
+}
+
+static JObject* ObjectSlot(JValue* value) {
+    return value->Type == JValueType::Object ? value->Data.ObjectData : nullptr;
+}
+
+static JArray* ArraySlot(JValue* value) {
+    return value->Type == JValueType::Array ? value->Data.ArrayData : nullptr;
+}
+
+static JRange* RangeSlot(JValue* value) {
+    return value->Type == JValueType::Array && value->Data.ArrayData->IsRange() ? &value->Data.ArrayData->AsRange : nullptr;
+}
+
+#define SET_MEMBER(Name, Key, Token, Kind) \
+    case JSpecialMember::Name: if (auto slot = Kind##Slot(member->Value)) { Members.Name = slot; } break;
+#define SET_EX_MEMBER(Name, Key, Token, Kind) \
+    case JSpecialMember::Name: if (auto slot = Kind##Slot(member->Value)) { ExMembers.Name = slot; } break;
+
+void JObject::SetSpecialMember(JMember* member) {
     switch(member->SpecialType) {
-        case JSpecialMember::ExTweet:       ExMembers.ExTweet       = member->Value->Data.ObjectData; break;
-        case JSpecialMember::Truncated:     ExMembers.Truncated     = &member->Value->Data.BoolData; break;
-        case JSpecialMember::DisplayRange:  ExMembers.DisplayRange  = &member->Value->Data.ArrayData->AsRange; break;
-        case JSpecialMember::Entities:      ExMembers.Entities      = member->Value->Data.ObjectData; break;
-        case JSpecialMember::Hashtags:      ExMembers.Hashtags      = member->Value->Data.ArrayData; break;
-        case JSpecialMember::Indices:      ExMembers.Indices      = &member->Value->Data.ArrayData->AsRange; break;
-        case JSpecialMember::FullText:      ExMembers.FullText      = member->Value->Data.StringData; break;
+        TWEET_FIELDS(SET_MEMBER)
+        EXTENDED_TWEET_FIELDS(SET_EX_MEMBER)
+        case JSpecialMember::None:
+            break;
     }
 }
 
+#undef SET_MEMBER
+#undef SET_EX_MEMBER
+
 bool JObject::FormsValidRetweetObj() const {
     // To be a valid "tweet" object we need at least valid "text" and "user" fields.
     if (!Members.Text || !Members.User) {
@@ -296,16 +414,61 @@ bool JObject::FormsValidRetweetObj() const {
     return true;
 }
 
+bool JObject::FormsValidRetweetStatus(std::string& FailMessage) const {
+    RetweetStatusFields Fields;
+    Fields.HasText = Members.Text;
+    Fields.HasUser = Members.User;
+    Fields.HasTweet = Members.TweetObj;
+    if (Members.User && Members.User->Members.UScreenName) {
+        Fields.ScreenName = Members.User->Members.UScreenName->Text;
+    }
+    if (Members.TweetObj && Members.TweetObj->Members.Text) {
+        Fields.RetweetUser = Members.TweetObj->Members.Text->RetweetUser;
+    }
+    return ::FormsValidRetweetStatus(Fields, FailMessage);
+}
+
+bool FormsValidRetweetStatus(const RetweetStatusFields& Fields, std::string& FailMessage) {
+    // A "retweet_status" does not always need a "tweet" object.
+    // but MUST have text and valid User Object
+    if (!Fields.HasText || !Fields.HasUser) {
+        FailMessage += "It is missing 'text' and/or 'user' field.";
+        return false;
+    }
+
+    // if there is a 'tweet' object we need to verify the username from RT @
+    // "user"->"screen_name" against "tweet"->"text" [@User]
+    if (Fields.HasTweet && Fields.ScreenName != Fields.RetweetUser) {
+        FailMessage += "RT @ user '" + std::string(Fields.RetweetUser) + "' is not the same as the original tweet user. '"
+            + std::string(Fields.ScreenName) + "'";
+        return false;
+    }
+    return true;
+}
+
 bool JObject::FormsValidOuterObject(std::string& FailMessage) const {
+    OuterObjectFields Fields;
+    Fields.HasRequired = Members.IdStr && Members.Text && Members.User && Members.CreatedAt;
+    Fields.TextLength = Members.Text ? Members.Text->Length : 0;
+    Fields.Truncated = ExMembers.Truncated && *ExMembers.Truncated;
+    if (ExMembers.DisplayRange) {
+        Fields.HasDisplayRange = true;
+        Fields.DisplayRange = *ExMembers.DisplayRange;
+    }
+    Fields.HasExTweet = ExMembers.ExTweet;
+    return ::FormsValidOuterObject(Fields, FailMessage);
+}
+
+bool FormsValidOuterObject(const OuterObjectFields& Fields, std::string& FailMessage) {
     
     // Our outer object MUST include IdStr, Text, User, Date.
-    if (!Members.IdStr || !Members.Text || !Members.User || !Members.CreatedAt) {
+    if (!Fields.HasRequired) {
         FailMessage += "Missing field IdStr/Text/User/CreatedAt";
         return false;
     }
 
     // if we dont find a truncated value or found one that == false we are done.
-    if (!ExMembers.Truncated || *ExMembers.Truncated == false) {
+    if (!Fields.Truncated) {
         return true;
     }
 
@@ -313,22 +476,22 @@ bool JObject::FormsValidOuterObject(std::string& FailMessage) const {
     // * a valid display_text_range [0, Members.Text.Length]
     // * an exteneded tweet object 
 
-    if (!ExMembers.DisplayRange) {
+    if (!Fields.HasDisplayRange) {
         FailMessage += "Missing display range when truncated == true.";
         return false;
     }
 
     // The display range must be from x->x+Length and x+Length must be less than 
-    unsigned int TextSize = Members.Text->Length;
-    if (ExMembers.DisplayRange->Begin != 0 ||
-        ExMembers.DisplayRange->End != TextSize) {
+    unsigned int TextSize = Fields.TextLength;
+    if (Fields.DisplayRange.Begin != 0 ||
+        Fields.DisplayRange.End != TextSize) {
 
         FailMessage += "Display Range did not match the given text.";
         return false;
     }
 
     // Finally check for the extended tweet object. 
-    if (!ExMembers.ExTweet) {
+    if (!Fields.HasExTweet) {
         FailMessage += "Missing extended tweet when truncated == true.";
         return false;
     }
@@ -341,34 +504,46 @@ bool JObject::FormsValidOuterObject(std::string& FailMessage) const {
 }
 
 bool JObject::FormsValidExtendedTweetObj(std::string& FailMessage) const {
+    ExtendedTweetFields Fields;
+    Fields.FullText = ExMembers.FullText;
+    if (ExMembers.DisplayRange) {
+        Fields.HasDisplayRange = true;
+        Fields.DisplayRange = *ExMembers.DisplayRange;
+    }
+    if (ExMembers.Entities) {
+        const ArenaVector<HashTagData>& Tags = ExMembers.Entities->ExMembers.Hashtags->Hashtags;
+        Fields.Hashtags = Tags.data();
+        Fields.HashtagCount = Tags.size();
+    }
+    return ::FormsValidExtendedTweetObj(Fields, FailMessage);
+}
+
+bool FormsValidExtendedTweetObj(const ExtendedTweetFields& Fields, std::string& FailMessage) {
 
     // Require full_text and display range.
-    if (!ExMembers.FullText || !ExMembers.DisplayRange) {
+    if (!Fields.FullText || !Fields.HasDisplayRange) {
         FailMessage += "Missing 'full_text' and/or 'display_text_range'.";
         return false;
     }
 
     // Validate text length with display range
-    unsigned int TextSize = ExMembers.FullText->Length;
-    if (ExMembers.DisplayRange->Begin != 0 ||
-        ExMembers.DisplayRange->End != TextSize) {
+    unsigned int TextSize = Fields.FullText->Length;
+    if (Fields.DisplayRange.Begin != 0 ||
+        Fields.DisplayRange.End != TextSize) {
 
         FailMessage += "Display Range did not match the given full_text.\nText Size:" + std::to_string(TextSize)
-            + " DisplayRange: " + std::to_string(ExMembers.DisplayRange->Begin) 
-            + "," + std::to_string(ExMembers.DisplayRange->End);
+            + " DisplayRange: " + std::to_string(Fields.DisplayRange.Begin) 
+            + "," + std::to_string(Fields.DisplayRange.End);
 
         return false;
     }
     
-    const JString& TextObj = *ExMembers.FullText;
+    const JString& TextObj = *Fields.FullText;
 
     // Even if we have NO hashtags in the text, we still need to verify that
     // there are no recorded hashtags in the array (but only if one exists.)
 
-    int HashtagsInArray = 0;
-    if (ExMembers.Entities) {
-        HashtagsInArray = ExMembers.Entities->ExMembers.Hashtags->Hashtags.size();
-    }
+    size_t HashtagsInArray = Fields.HashtagCount;
 
     if (HashtagsInArray != TextObj.Hashtags.size()) {
         FailMessage += "Hashtags found in text did not match all the hashtags in the entites.";
@@ -381,14 +556,30 @@ bool JObject::FormsValidExtendedTweetObj(std::string& FailMessage) const {
     }
 
     // The hashtags found in the entities array.
-    std::vector<HashTagData>& Tags = ExMembers.Entities->ExMembers.Hashtags->Hashtags;
+    const HashTagData* const Tags = Fields.Hashtags;
 
     // All that is left is to verify hashtag positions on the actual text.
-    // The hash tags could be in random order so do N^2 for now. 
-    // TODO: this could be optimized by using unordered_sets instead of vectors
+    // The hash tags could be in random order, index the entities ones by (Begin, Tag) so each lookup is O(1).
+    size_t Capacity = 16;
+    while (Capacity < Fields.HashtagCount * 2) {
+        Capacity *= 2;
+    }
+    std::vector<const HashTagData*> Index(Capacity, nullptr);
+    for (size_t i = 0; i < Fields.HashtagCount; ++i) {
+        size_t Slot = Tags[i].Hash() & (Capacity - 1);
+        while (Index[Slot]) {
+            Slot = (Slot + 1) & (Capacity - 1);
+        }
+        Index[Slot] = &Tags[i];
+    }
+
     for (const HashTagData& Outer : TextObj.Hashtags) {
-        if (std::find(Tags.cbegin(), Tags.cend(), Outer) == Tags.cend()) {
-            FailMessage += "Hashtag: '" + Outer.Tag + "' is missing from the entities array or has"
+        size_t Slot = Outer.Hash() & (Capacity - 1);
+        while (Index[Slot] && !(*Index[Slot] == Outer)) {
+            Slot = (Slot + 1) & (Capacity - 1);
+        }
+        if (!Index[Slot]) {
+            FailMessage += "Hashtag: '" + std::string(Outer.Tag) + "' is missing from the entities array or has"
                 + " incorrect Indices.";
             return false;
         }
@@ -411,26 +602,32 @@ bool JArray::ExtractHashtags(std::string& Error) {
 
         // Now check this object to find if it includes "text" & "indices" they are required.
         JObject* Subobject = Element->Data.ObjectData;
-        if (!Subobject->Members.Text || !Subobject->ExMembers.Indices) {
-            Error += "An element of the array is missing 'text' and/or 'indices'.";
-            return false;
-        }
-
-        // Also validate indice length. The actual # is not included in the text but it is accounted in indice length
-        // Therefore we need to offset the length by 1
-        long long IndiceLength = Subobject->ExMembers.Indices->End - Subobject->ExMembers.Indices->Begin;
-        if (IndiceLength != Subobject->Members.Text->Length + 1) {
-            Error += "Indice range did not match the text length.";
+        HashTagData Data;
+        if (!HashtagOfEntity(Subobject->Members.Text, Subobject->ExMembers.Indices, Data, Error)) {
             return false;
-
         }
 
         // Everything is correct. Collect this result and add it to the hashtags vector.
-        HashTagData Data;
-        Data.Tag = Subobject->Members.Text->Text;
-        Data.Begin = Subobject->ExMembers.Indices->Begin;
-
         Hashtags.push_back(Data);
     }
     return true;
-}
\ No newline at end of file
+}
+bool HashtagOfEntity(const JString* Text, const JRange* Indices, HashTagData& Hashtag, std::string& Error) {
+    if (!Text || !Indices) {
+        Error += "An element of the array is missing 'text' and/or 'indices'.";
+        return false;
+    }
+
+    // Also validate indice length. The actual # is not included in the text but it is accounted in indice length
+    // Therefore we need to offset the length by 1
+    long long IndiceLength = Indices->End - Indices->Begin;
+    if (IndiceLength != Text->Length + 1) {
+        Error += "Indice range did not match the text length.";
+        return false;
+
+    }
+
+    Hashtag.Tag = Text->Text;
+    Hashtag.Begin = Indices->Begin;
+    return true;
+}
@@ -3,24 +3,30 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <iostream>
-#include <unordered_set>
 #include <cstring>
 
+#include "arena.h"
+#include "json_db.h"
+#include "schema.h"
+#include "json_writer.h"
+
 
 struct JObject;
 struct JArray;
 struct JString;
 
-// Global DB keeping track of ids
-struct JsonDB {
-    std::unordered_set<std::string> IdStrs;
-    std::unordered_set<long long> UserIds;
+// Text of a string token without its quotes. 
+// Points either in the input buffer or in the arena of the document, it is NOT NUL terminated.
+// (Plain POD so it can be part of the bison %union)
+struct TextRef {
+    const char* Data;
+    size_t Length;
 
-    // Attempts to Insert an id_str element in the database. Returns false if it already existed
-    bool MaybeInsertIdStr(const char* id_str);
-    // Attempts to Insert a user_id element in the database. Returns false if it already existed
-    bool MaybeInsertUserId(long long id);
+    std::string_view View() const {
+        return std::string_view(Data, Length);
+    }
 };
 
 enum class JValueType {
@@ -29,6 +35,8 @@ enum class JValueType {
     String,
     Float,
     Int,
+    // An integer outside the int64 range kept as its digits, see ParseSettings::KeepBigInts.
+    BigInt,
     Bool,
     NullVal
 };
@@ -37,40 +45,19 @@ union JValueData {
     JObject* ObjectData;
     JArray* ArrayData;
     JString* StringData;
-    float FloatData;
+    double FloatData;
     long long IntData;
+    TextRef BigIntData;
     bool BoolData;
     
     JValueData() {};
     ~JValueData() {};
 };
 
-// Special members are all the members required for the assignment.
-enum class JSpecialMember {
-    None, // Not a special member
-    IdStr,
-    Text,
-    CreatedAt,
-    User,
-    UName,
-    UScreenName,
-    ULocation,
-    UId,
-    // Assignment 2a
-    TweetObj,
-    // Assignment 2b
-    ExTweet,
-    Truncated,
-    DisplayRange,
-    Entities,
-    Hashtags,
-    Indices,
-    FullText
-};
-
 // POD utility for storing a starting point of a hashtag and its text.
+// The tag points into the text of the JString (or array) that it was found in.
 struct HashTagData {
-    std::string Tag;
+    std::string_view Tag;
     unsigned int Begin;
 
     unsigned int GetEnd() const {
@@ -80,34 +67,48 @@ struct HashTagData {
     bool operator==(const HashTagData& other) const {
        return Begin == other.Begin && Tag == other.Tag;
     }
+
+    size_t Hash() const {
+        return std::hash<std::string_view>()(Tag) ^ (Begin * 0x9E3779B97F4A7C15ULL);
+    }
 };
 
 // We use our own specialized string struct that stores hash tags, length, byte length.
+// Text points to the token itself when there is nothing to decode, otherwise to a decoded copy in the arena.
 struct JString {
-    // 'actuall' length after merging unicode characters as 1 chars.
+    // 'actuall' length in code points, escapes count as 1 character.
     // to get byte length use Text.length()
     unsigned int Length;
+    // False if the text has malformed UTF-8, Length is not meaningful then.
+    bool ValidUtf8;
 
     // Converted text.
-    std::string Text;
+    std::string_view Text;
     // This will contain the hashtags found (if any)
-    std::vector<HashTagData> Hashtags;
-    std::string RetweetUser;
+    ArenaVector<HashTagData> Hashtags;
+    std::string_view RetweetUser;
 
-    JString(char* cstring);
+    JString(Arena& arena, TextRef source);
 
-    std::ostream& Print(std::ostream& os) const;
+    void Print(JsonWriter& out) const;
 
     bool IsRetweet() const;
+
+private:
+    void ExtractRetweetUser();
 };
 
 
 
+// Decodes a string token like JString does (escapes and percent encoding) into 'out', which must have room
+// for 'from.Length' bytes. Returns the length of the decoded text.
+size_t DecodeText(TextRef from, char* out);
+
 struct JValue {
     JValueType Type;
     JValueData Data;
 
-    std::ostream& Print(std::ostream& os, int indentation) const;
+    void Print(JsonWriter& out, int indentation) const;
 
     JValue() {
         Type = JValueType::NullVal;
@@ -124,18 +125,16 @@ struct JValue {
         Data.ArrayData = data;
     }
 
-    JValue(char* data) {
-        JString* jstr = new JString(data);
-        Type = JValueType::String;
-        Data.StringData = jstr;
-    }
-    
+    // Strings need decoding in an arena, see ParseContext::NewString. 
+    // Deleted so a pointer can't silently convert to the bool constructor.
+    JValue(const char* data) = delete;
+
     JValue(JString* data) {
         Type = JValueType::String;
         Data.StringData = data;
     }
 
-    JValue(float num) {
+    JValue(double num) {
         Type = JValueType::Float;
         Data.FloatData = num;
     }
@@ -145,6 +144,14 @@ struct JValue {
         Data.IntData = num;
     }
 
+    // The digits of a BigInt, they must outlive the value (input buffer or arena, see ParseContext::TokenText).
+    static JValue BigInt(TextRef digits) {
+        JValue value;
+        value.Type = JValueType::BigInt;
+        value.Data.BigIntData = digits;
+        return value;
+    }
+
     JValue(bool value) {
         Type = JValueType::Bool;
         Data.BoolData = value;
@@ -166,20 +173,22 @@ struct JRange {
 };
 
 struct JArray {
-    std::vector<JValue*> Elements;
+    ArenaVector<JValue*> Elements;
     JRange AsRange;
 
     // this is only used if this is a hashtag array.
-    std::vector<HashTagData> Hashtags;
-
-    JArray() {}
-
-    JArray(long long from, long long to)
-        : AsRange(from, to) {
-            // Watch out the order here...
-            // We 'emulate' our parsing and push back in reverse order.
-            Elements.push_back(new JValue(to));
-            Elements.push_back(new JValue(from));
+    ArenaVector<HashTagData> Hashtags;
+
+    JArray(Arena& arena)
+        : Elements(arena)
+        , Hashtags(arena) {}
+
+    JArray(Arena& arena, long long from, long long to)
+        : Elements(arena)
+        , AsRange(from, to)
+        , Hashtags(arena) {
+            Elements.push_back(new (arena) JValue(from));
+            Elements.push_back(new (arena) JValue(to));
         }
 
     void AddValue(JValue* value) {
@@ -191,44 +200,48 @@ struct JArray {
         return AsRange.Begin >= 0;
     }
 
-    std::ostream& Print(std::ostream& os, int indentation) const;
+    void Print(JsonWriter& out, int indentation) const;
 
     // Attempts to exract and populate the Hashtags vector from the elements.
     // Returns true if this array forms a valid "hashtags" array. 
     bool ExtractHashtags(std::string& Error);
 };
 
+// The hashtag of an element of a "hashtags" array, from its 'text' and 'indices' (null if it has none).
+// Shared by both DOMs (JArray and TapeArray). Returns false with the reason in 'Error' if they don't form one.
+bool HashtagOfEntity(const JString* Text, const JRange* Indices, HashTagData& Hashtag, std::string& Error);
+
 struct JMember {
-    std::string Name;
+    std::string_view Name;
     JValue* Value;
     JSpecialMember SpecialType;
 
-    std::ostream& Print(std::ostream& os, int indentation) const;
+    void Print(JsonWriter& out, int indentation) const;
 
-    JMember(const char* name, JValue* value, JSpecialMember type = JSpecialMember::None)
-        : Name(std::string(name))
+    JMember(TextRef name, JValue* value, JSpecialMember type = JSpecialMember::None)
+        : Name(name.View())
         , Value(value)
         , SpecialType(type) {}
 };
 
 
+// Slot type of each schema Kind (see schema.h).
+#define SCHEMA_SLOT_String  JString*
+#define SCHEMA_SLOT_Int     long long*
+#define SCHEMA_SLOT_Bool    bool*
+#define SCHEMA_SLOT_Object  JObject*
+#define SCHEMA_SLOT_Array   JArray*
+#define SCHEMA_SLOT_Range   JRange*
+
+#define SCHEMA_DECLARE_SLOT(Name, Key, Token, Kind) SCHEMA_SLOT_##Kind Name = nullptr;
+
 // A 'special' members struct that holds pointers to specific assignment dependant members
 // We don't save the actual metadata but pointers to the values directly
 // when any of these pointers are null it means the object does not contain that specific member at all
 //
 // eg: we only care about the actual JString of a member with name 'text' and we only accept JString as its value.
 struct JSpecialMembers {
-    JString* IdStr = nullptr;
-    JString* Text = nullptr;
-    JString* CreatedAt = nullptr;
-    JObject* User = nullptr;
-
-    JString* UName = nullptr;
-    JString* UScreenName = nullptr;
-    JString* ULocation = nullptr;
-    long long* UId = nullptr;
-
-    JObject* TweetObj = nullptr;
+    TWEET_FIELDS(SCHEMA_DECLARE_SLOT)
 
     bool FormsValidUser(bool RequireAll = false) const {
         if (RequireAll) {
@@ -240,28 +253,33 @@ struct JSpecialMembers {
 
 // Special members for extended tweets, same as above
 struct JExSpecialMembers {
-    JObject* ExTweet = nullptr;
-    bool* Truncated = nullptr;
-    JRange* DisplayRange = nullptr;
-    JObject* Entities = nullptr;
-    JArray* Hashtags = nullptr;
-    JRange* Indices = nullptr;
-    JString* FullText = nullptr;
+    EXTENDED_TWEET_FIELDS(SCHEMA_DECLARE_SLOT)
 };
 
+#undef SCHEMA_DECLARE_SLOT
+
 struct JObject {
-    std::vector<JMember*> Memberlist;
+    ArenaVector<JMember*> Memberlist;
     JSpecialMembers Members;
     JExSpecialMembers ExMembers;
 
-    std::ostream& Print(std::ostream& os, int indentation) const;
+    JObject(Arena& arena)
+        : Memberlist(arena) {}
+
+    void Print(JsonWriter& out, int indentation) const;
 
     
     bool FormsValidRetweetObj() const;
 
+    // Checks if this JObject forms a valid "retweeted_status" object.
+    bool FormsValidRetweetStatus(std::string& FailMessage) const;
+
     // Add a member to the Memberlist and resolve if it needs to popule some Members.* or ExMembers.* field.
     void AddMember(JMember* member);
 
+    // Only populate the Members.* or ExMembers.* field, the member is not kept in the Memberlist.
+    void SetSpecialMember(JMember* member);
+
     // Checks if this JObject forms a valid "outer" object 
     // ie MUST have text, valid user, IdStr, date AND extra if truncated = true
     bool FormsValidOuterObject(std::string& FailMessage) const;
@@ -269,19 +287,53 @@ struct JObject {
     // Checks if this JObject forms a valid "extended tweet" object
     // extended tweet MUST include valid hashtags as entities if there are any.
     bool FormsValidExtendedTweetObj(std::string& FailMessage) const;
+};
 
-private:
-    // Use another function for all the ExMembers just for code readability
-    void SwitchOnExMember(JMember* member);
+// What the outer object checks look at. Filled from either DOM (JObject or TapeObject) so both share the checks.
+struct OuterObjectFields {
+    // IdStr, Text, User and CreatedAt are all there.
+    bool HasRequired = false;
+    // Code points of the text.
+    unsigned int TextLength = 0;
+    bool Truncated = false;
+    bool HasDisplayRange = false;
+    JRange DisplayRange;
+    bool HasExTweet = false;
+};
+
+bool FormsValidOuterObject(const OuterObjectFields& Fields, std::string& FailMessage);
+
+// What the "retweeted_status" checks look at, same as above.
+struct RetweetStatusFields {
+    bool HasText = false;
+    bool HasUser = false;
+    bool HasTweet = false;
+    // screen_name of the user and the RT @ user of the text of the tweet, when there is a tweet.
+    std::string_view ScreenName;
+    std::string_view RetweetUser;
 };
 
+bool FormsValidRetweetStatus(const RetweetStatusFields& Fields, std::string& FailMessage);
+
+// What the extended tweet checks look at, same as above.
+struct ExtendedTweetFields {
+    const JString* FullText = nullptr;
+    bool HasDisplayRange = false;
+    JRange DisplayRange;
+    // The hashtags of the entities, none without entities.
+    const HashTagData* Hashtags = nullptr;
+    size_t HashtagCount = 0;
+};
+
+bool FormsValidExtendedTweetObj(const ExtendedTweetFields& Fields, std::string& FailMessage);
+
 struct JJson {
     JValue* JsonData;
 
     JJson(JValue* data)
         : JsonData(data) {}
 
-    std::ostream& Print(std::ostream& os) const;
+    void Print(JsonWriter& out) const;
 };
 
 #endif //__JSON_CLASSES_
\ No newline at end of file
@@ -0,0 +1,483 @@
+#include "json_db.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <vector>
+
+// --- Snapshot file layout ------------------------------------------------------------------------------------
+// Header, then the slot table of every IdSet (64 byte aligned, exactly as IdSet keeps them in memory),
+// then the long id_strs of every shard as [uint32 length][bytes].
+
+static const char SnapshotMagic[8] = { 'J', 'S', 'O', 'N', 'D', 'B', 'S', 'N' };
+static const uint32_t SnapshotVersion = 1;
+
+// Hash of a fixed id, a snapshot written with a different IdSet::Hash can't be adopted.
+static const uint64_t HashCheckId = 1234567890123456789ULL;
+
+struct SnapshotSet {
+    uint64_t Offset;
+    uint64_t Capacity;
+    uint64_t Count;
+    uint64_t HasZero;
+};
+
+struct SnapshotShard {
+    SnapshotSet IdStrs;
+    SnapshotSet UserIds;
+    uint64_t LongOffset;
+    uint64_t LongCount;
+};
+
+struct SnapshotHeader {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t ShardCount;
+    uint64_t HashCheck;
+    uint64_t Length;
+    SnapshotShard Shards[JsonDB::ShardCount];
+};
+
+static uint64_t AlignUp(uint64_t offset) {
+    return (offset + 63) & ~(uint64_t)63;
+}
+
+// The value of an id_str if it maps back to the same text, ie: no leading zeros and no overflow.
+static bool IdStrValue(std::string_view text, uint64_t& value) {
+    if (text.empty() || text.length() > 19 || (text[0] == '0' && text.length() > 1)) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+// Syncs the directory 'path' is in, so a file renamed there stays renamed after a crash.
+static bool SyncDirectoryOf(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    const std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+JsonDB::~JsonDB() {
+    if (JournalFile) {
+        fclose(JournalFile);
+    }
+    if (Mapping) {
+        munmap(Mapping, MappingLength);
+    }
+}
+
+bool JsonDB::MaybeInsertIdStr(std::string_view data) {
+    bool inserted;
+    uint64_t id;
+    if (IdStrValue(data, id)) {
+        Shard& shard = ShardOf(Shards, IdSet::Hash(id));
+        std::lock_guard<std::mutex> guard(shard.Lock);
+        inserted = shard.IdStrs.Insert(id);
+        if (inserted && JournalFile) {
+            Journal(JournalIdStr, id);
+        }
+    }
+    else {
+        Shard& shard = Shards[std::hash<std::string_view>()(data) % ShardCount];
+        std::lock_guard<std::mutex> guard(shard.Lock);
+        inserted = shard.LongIdStrs.emplace(data).second;
+        if (inserted && JournalFile) {
+            Journal(JournalLongIdStr, 0, data);
+        }
+    }
+
+    if (inserted) {
+        MaybeCheckpoint();
+    }
+    // return if insert actually happened
+    return inserted;
+}
+
+bool JsonDB::MaybeInsertUserId(long long id) {
+    bool inserted;
+    {
+        Shard& shard = ShardOf(Shards, IdSet::Hash((uint64_t)id));
+        std::lock_guard<std::mutex> guard(shard.Lock);
+        inserted = shard.UserIds.Insert((uint64_t)id);
+        if (inserted && JournalFile) {
+            Journal(JournalUserId, (uint64_t)id);
+        }
+    }
+
+    if (inserted) {
+        MaybeCheckpoint();
+    }
+    return inserted;
+}
+
+bool JsonDB::ContainsIdStr(std::string_view data) {
+    uint64_t id;
+    if (IdStrValue(data, id)) {
+        Shard& shard = ShardOf(Shards, IdSet::Hash(id));
+        std::lock_guard<std::mutex> guard(shard.Lock);
+        return shard.IdStrs.Contains(id);
+    }
+    Shard& shard = Shards[std::hash<std::string_view>()(data) % ShardCount];
+    std::lock_guard<std::mutex> guard(shard.Lock);
+    return shard.LongIdStrs.count(std::string(data)) != 0;
+}
+
+bool JsonDB::ContainsUserId(long long id) {
+    Shard& shard = ShardOf(Shards, IdSet::Hash((uint64_t)id));
+    std::lock_guard<std::mutex> guard(shard.Lock);
+    return shard.UserIds.Contains((uint64_t)id);
+}
+
+void JsonDB::Reserve(size_t records) {
+    // Spread evenly by the hash, with some slack for the uneven shards.
+    const size_t perShard = records / ShardCount + records / ShardCount / 8;
+    for (Shard& shard : Shards) {
+        std::lock_guard<std::mutex> guard(shard.Lock);
+        shard.IdStrs.Reserve(perShard);
+        shard.UserIds.Reserve(perShard);
+    }
+}
+
+void JsonDB::UseWindow(long long seconds, int buckets, bool bloom) {
+    WindowIdStrs.reset(new IdWindow(seconds, buckets, bloom));
+    WindowUserIds.reset(new IdWindow(seconds, buckets, bloom));
+}
+
+// The windowed key of an id_str. Long ids go by their hash, a collision of two different ids within one window
+// is not a concern.
+static uint64_t WindowKey(std::string_view data) {
+    uint64_t id;
+    if (!IdStrValue(data, id)) {
+        id = std::hash<std::string_view>()(data);
+    }
+    return id;
+}
+
+bool JsonDB::MaybeInsertIdStr(std::string_view data, long long time) {
+    return WindowIdStrs->MaybeInsert(WindowKey(data), time);
+}
+
+bool JsonDB::MaybeInsertUserId(long long id, long long time) {
+    return WindowUserIds->MaybeInsert((uint64_t)id, time);
+}
+
+bool JsonDB::ContainsIdStr(std::string_view data, long long time) {
+    return WindowIdStrs->Contains(WindowKey(data), time);
+}
+
+bool JsonDB::ContainsUserId(long long id, long long time) {
+    return WindowUserIds->Contains((uint64_t)id, time);
+}
+
+// --- Persistence ---------------------------------------------------------------------------------------------
+
+bool JsonDB::Open(const std::string& path, size_t checkpointEvery, std::ostream& err) {
+    Path = path;
+    if (!LoadSnapshot(err) || !ReplayJournal(err)) {
+        return false;
+    }
+    CheckpointEvery = checkpointEvery;
+
+    JournalFile = fopen((Path + ".journal").c_str(), "ab");
+    if (!JournalFile) {
+        err << "Could not open the id journal '" << Path << ".journal'.\n";
+        return false;
+    }
+    return true;
+}
+
+bool JsonDB::LoadSnapshot(std::ostream& err) {
+    const int fd = open(Path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        // First run, nothing to load.
+        return true;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+        close(fd);
+        err << "Id snapshot '" << Path << "' is truncated.\n";
+        return false;
+    }
+
+    // Private writable mapping: the sets write into it and pages are only copied when they do.
+    const size_t length = info.st_size;
+    void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        err << "Could not map the id snapshot '" << Path << "'.\n";
+        return false;
+    }
+    Mapping = mapped;
+    MappingLength = length;
+
+    char* base = (char*)mapped;
+    const SnapshotHeader& header = *(const SnapshotHeader*)base;
+    if (memcmp(header.Magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0 || header.Version != SnapshotVersion ||
+        header.ShardCount != ShardCount || header.HashCheck != IdSet::Hash(HashCheckId) || header.Length != length) {
+        err << "'" << Path << "' is not an id snapshot of this version.\n";
+        return false;
+    }
+
+    auto adopt = [&](IdSet& set, const SnapshotSet& stored) {
+        if (stored.Capacity == 0) {
+            return stored.Count == 0;
+        }
+        if (stored.Offset % 64 || stored.Offset > length || stored.Capacity > (length - stored.Offset) / sizeof(uint64_t)) {
+            return false;
+        }
+        return set.Adopt((uint64_t*)(base + stored.Offset), stored.Capacity, stored.Count, stored.HasZero != 0);
+    };
+
+    for (int i = 0; i < ShardCount; ++i) {
+        const SnapshotShard& stored = header.Shards[i];
+        Shard& shard = Shards[i];
+        if (!adopt(shard.IdStrs, stored.IdStrs) || !adopt(shard.UserIds, stored.UserIds)) {
+            err << "Id snapshot '" << Path << "' is corrupt (shard " << i << ").\n";
+            return false;
+        }
+
+        uint64_t offset = stored.LongOffset;
+        for (uint64_t j = 0; j < stored.LongCount; ++j) {
+            uint32_t textLength;
+            if (offset > length || length - offset < sizeof(textLength)) {
+                err << "Id snapshot '" << Path << "' is corrupt (shard " << i << ").\n";
+                return false;
+            }
+            memcpy(&textLength, base + offset, sizeof(textLength));
+            offset += sizeof(textLength);
+            if (length - offset < textLength) {
+                err << "Id snapshot '" << Path << "' is corrupt (shard " << i << ").\n";
+                return false;
+            }
+            shard.LongIdStrs.emplace(base + offset, textLength);
+            offset += textLength;
+        }
+    }
+    return true;
+}
+
+bool JsonDB::ReplayJournal(std::ostream& err) {
+    FILE* file = fopen((Path + ".journal").c_str(), "rb");
+    if (!file) {
+        return true;
+    }
+
+    std::vector<char> data;
+    char block[64 * 1024];
+    size_t read;
+    while ((read = fread(block, 1, sizeof(block), file)) > 0) {
+        data.insert(data.end(), block, block + read);
+    }
+    const bool failed = ferror(file);
+    fclose(file);
+    if (failed) {
+        err << "Could not read the id journal '" << Path << ".journal'.\n";
+        return false;
+    }
+
+    // A record cut short by a crash ends the replay, everything before it is complete.
+    size_t i = 0;
+    while (i < data.size()) {
+        const uint8_t type = data[i];
+        if (type == JournalIdStr || type == JournalUserId) {
+            uint64_t id;
+            if (data.size() - i < 1 + sizeof(id)) {
+                break;
+            }
+            memcpy(&id, &data[i + 1], sizeof(id));
+            i += 1 + sizeof(id);
+
+            Shard& shard = ShardOf(Shards, IdSet::Hash(id));
+            (type == JournalIdStr ? shard.IdStrs : shard.UserIds).Insert(id);
+        }
+        else if (type == JournalLongIdStr) {
+            uint32_t textLength;
+            if (data.size() - i < 1 + sizeof(textLength)) {
+                break;
+            }
+            memcpy(&textLength, &data[i + 1], sizeof(textLength));
+            if (data.size() - i - 1 - sizeof(textLength) < textLength) {
+                break;
+            }
+            MaybeInsertIdStr(std::string_view(&data[i + 1 + sizeof(textLength)], textLength));
+            i += 1 + sizeof(textLength) + textLength;
+        }
+        else {
+            err << "Id journal '" << Path << ".journal' is corrupt at byte " << i << ".\n";
+            return false;
+        }
+    }
+
+    // Drop the partial record so new ones are appended after the complete ones.
+    if (i < data.size() && truncate((Path + ".journal").c_str(), i) != 0) {
+        err << "Could not truncate the id journal '" << Path << ".journal'.\n";
+        return false;
+    }
+    return true;
+}
+
+void JsonDB::Journal(uint8_t type, uint64_t id, std::string_view text) {
+    std::lock_guard<std::mutex> guard(JournalLock);
+    fputc(type, JournalFile);
+    if (type == JournalLongIdStr) {
+        const uint32_t textLength = text.length();
+        fwrite(&textLength, sizeof(textLength), 1, JournalFile);
+        fwrite(text.data(), 1, text.length(), JournalFile);
+    }
+    else {
+        fwrite(&id, sizeof(id), 1, JournalFile);
+    }
+}
+
+void JsonDB::FlushJournal() {
+    if (!JournalFile) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(JournalLock);
+    fflush(JournalFile);
+}
+
+void JsonDB::MaybeCheckpoint() {
+    if (!CheckpointEvery || ++SinceCheckpoint < CheckpointEvery) {
+        return;
+    }
+    // One thread checkpoints, the others keep going.
+    std::unique_lock<std::mutex> lock(CheckpointLock, std::try_to_lock);
+    if (lock.owns_lock() && SinceCheckpoint >= CheckpointEvery) {
+        Checkpoint(std::cerr);
+    }
+}
+
+bool JsonDB::Checkpoint(std::ostream& err) {
+    if (Path.empty()) {
+        return true;
+    }
+
+    // Same order as the inserts (shard, then journal) so nothing changes while the snapshot is written.
+    for (Shard& shard : Shards) {
+        shard.Lock.lock();
+    }
+    JournalLock.lock();
+
+    const bool ok = WriteSnapshot(err);
+    if (ok && JournalFile) {
+        // Everything in the journal is in the snapshot now.
+        fflush(JournalFile);
+        if (ftruncate(fileno(JournalFile), 0) != 0 || fsync(fileno(JournalFile)) != 0) {
+            err << "Could not truncate the id journal '" << Path << ".journal'.\n";
+        }
+    }
+    SinceCheckpoint = 0;
+
+    JournalLock.unlock();
+    for (Shard& shard : Shards) {
+        shard.Lock.unlock();
+    }
+    return ok;
+}
+
+bool JsonDB::WriteSnapshot(std::ostream& err) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.Magic, SnapshotMagic, sizeof(SnapshotMagic));
+    header.Version = SnapshotVersion;
+    header.ShardCount = ShardCount;
+    header.HashCheck = IdSet::Hash(HashCheckId);
+
+    // Lay out the tables first, then the long ids.
+    uint64_t offset = AlignUp(sizeof(header));
+    auto place = [&](SnapshotSet& stored, const IdSet& set) {
+        stored.Capacity = set.SlotCount();
+        stored.Count = set.Size();
+        stored.HasZero = set.ContainsZero();
+        stored.Offset = stored.Capacity ? offset : 0;
+        offset = AlignUp(offset + stored.Capacity * sizeof(uint64_t));
+    };
+    for (int i = 0; i < ShardCount; ++i) {
+        place(header.Shards[i].IdStrs, Shards[i].IdStrs);
+        place(header.Shards[i].UserIds, Shards[i].UserIds);
+    }
+    for (int i = 0; i < ShardCount; ++i) {
+        header.Shards[i].LongOffset = offset;
+        header.Shards[i].LongCount = Shards[i].LongIdStrs.size();
+        for (const std::string& text : Shards[i].LongIdStrs) {
+            offset += sizeof(uint32_t) + text.length();
+        }
+    }
+    header.Length = offset;
+
+    const std::string temporary = Path + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        err << "Could not write the id snapshot '" << temporary << "'.\n";
+        return false;
+    }
+
+    static const char Padding[64] = {};
+    uint64_t written = 0;
+    auto write = [&](const void* data, size_t length) {
+        fwrite(data, 1, length, file);
+        written += length;
+    };
+    auto pad = [&]() {
+        write(Padding, AlignUp(written) - written);
+    };
+
+    write(&header, sizeof(header));
+    pad();
+    for (int i = 0; i < ShardCount; ++i) {
+        write(Shards[i].IdStrs.Data(), Shards[i].IdStrs.SlotCount() * sizeof(uint64_t));
+        pad();
+        write(Shards[i].UserIds.Data(), Shards[i].UserIds.SlotCount() * sizeof(uint64_t));
+        pad();
+    }
+    for (int i = 0; i < ShardCount; ++i) {
+        for (const std::string& text : Shards[i].LongIdStrs) {
+            const uint32_t textLength = text.length();
+            write(&textLength, sizeof(textLength));
+            write(text.data(), text.length());
+        }
+    }
+
+    const bool ok = fflush(file) == 0 && !ferror(file) && fsync(fileno(file)) == 0;
+    fclose(file);
+    if (!ok || written != header.Length || rename(temporary.c_str(), Path.c_str()) != 0) {
+        err << "Could not write the id snapshot '" << Path << "'.\n";
+        remove(temporary.c_str());
+        return false;
+    }
+    // The rename only lasts once the directory is synced too.
+    if (!SyncDirectoryOf(Path)) {
+        err << "Could not sync the directory of the id snapshot '" << Path << "'.\n";
+        return false;
+    }
+    return true;
+}
+
+bool JsonDB::Close(std::ostream& err) {
+    if (Path.empty()) {
+        return true;
+    }
+    const bool ok = Checkpoint(err);
+    if (JournalFile) {
+        fclose(JournalFile);
+        JournalFile = nullptr;
+    }
+    return ok;
+}
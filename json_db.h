@@ -0,0 +1,124 @@
+#ifndef __JSON_DB_H_
+#define __JSON_DB_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <iostream>
+#include <memory>
+
+#include "id_set.h"
+#include "id_window.h"
+
+// Global DB keeping track of ids.
+// It is shared by every parse of a run so its split in independently locked shards (by hash)
+// to keep concurrent parsers from serializing on a single set.
+// Ids are kept as integers, id_str is always digits (D_ID_STR) and only those with leading zeros
+// or more than 19 digits need to be kept as strings.
+//
+// The ids can also be kept on disk (see Open) so they survive restarts and separate batches:
+//  <path>          Snapshot of every shard. The id tables are written in their in memory layout so loading
+//                  is a copy-on-write mapping of the file, nothing is read or rehashed up front.
+//  <path>.journal  Ids inserted since the snapshot, appended as they come and replayed on Open.
+// A checkpoint writes a new snapshot (atomically replacing the old one) and empties the journal.
+struct JsonDB {
+    static const int ShardCount = 64;
+
+    struct alignas(64) Shard {
+        std::mutex Lock;
+        IdSet IdStrs;
+        IdSet UserIds;
+        std::unordered_set<std::string> LongIdStrs;
+    };
+
+    Shard Shards[ShardCount];
+
+    JsonDB() {}
+    ~JsonDB();
+
+    JsonDB(const JsonDB&) = delete;
+    JsonDB& operator=(const JsonDB&) = delete;
+
+    // Attempts to Insert an id_str element in the database. Returns false if it already existed
+    bool MaybeInsertIdStr(std::string_view id_str);
+    // Attempts to Insert a user_id element in the database. Returns false if it already existed
+    bool MaybeInsertUserId(long long id);
+
+    // Whether the Insert of the id would return false, without inserting it.
+    bool ContainsIdStr(std::string_view id_str);
+    bool ContainsUserId(long long id);
+
+    // Sizes the sets for about 'records' tweets so they don't rehash while parsing.
+    void Reserve(size_t records);
+
+    // Only rejects ids seen within 'seconds' of created_at from now on, see IdWindow.
+    // The ids are checked per record (the Windowed overloads) when the created_at of the record is known.
+    void UseWindow(long long seconds, int buckets, bool bloom);
+
+    bool Windowed() const {
+        return WindowIdStrs != nullptr;
+    }
+
+    // Windowed versions of the above, 'time' is the created_at of the record in seconds since the epoch.
+    bool MaybeInsertIdStr(std::string_view id_str, long long time);
+    bool MaybeInsertUserId(long long id, long long time);
+    bool ContainsIdStr(std::string_view id_str, long long time);
+    bool ContainsUserId(long long id, long long time);
+
+    // Loads the snapshot and journal at 'path' (if they exist) and journals every insert from now on.
+    // With 'checkpointEvery' > 0 a checkpoint is made after that many new ids.
+    // Must be called before parsing starts. Returns false (with the reason in 'err') if the files can't be used.
+    bool Open(const std::string& path, size_t checkpointEvery, std::ostream& err);
+
+    // Hands the journal entries of the inserts so far to the OS, so they survive the process. Called once per
+    // record, before its verdict is printed. Does nothing without a journal.
+    void FlushJournal();
+
+    // Writes a new snapshot and empties the journal, both synced to disk. Safe to call while other threads insert.
+    bool Checkpoint(std::ostream& err);
+
+    // Final checkpoint, closes the journal.
+    bool Close(std::ostream& err);
+
+private:
+    static Shard& ShardOf(Shard* shards, uint64_t hash) {
+        return shards[(hash >> 32) % ShardCount];
+    }
+
+    // Journal record types.
+    enum : uint8_t {
+        JournalIdStr = 1,
+        JournalUserId = 2,
+        JournalLongIdStr = 3
+    };
+
+    bool LoadSnapshot(std::ostream& err);
+    bool ReplayJournal(std::ostream& err);
+    bool WriteSnapshot(std::ostream& err);
+
+    // Called with the lock of the shard the id went in held.
+    void Journal(uint8_t type, uint64_t id, std::string_view text = std::string_view());
+    // Called after the shard lock is released.
+    void MaybeCheckpoint();
+
+    std::string Path;
+    FILE* JournalFile = nullptr;
+    std::mutex JournalLock;
+
+    size_t CheckpointEvery = 0;
+    std::atomic<size_t> SinceCheckpoint{0};
+    std::mutex CheckpointLock;
+
+    std::unique_ptr<IdWindow> WindowIdStrs;
+    std::unique_ptr<IdWindow> WindowUserIds;
+
+    // The snapshot mapping adopted by the IdSets.
+    void* Mapping = nullptr;
+    size_t MappingLength = 0;
+};
+
+#endif //__JSON_DB_H_
@@ -0,0 +1,35 @@
+#ifndef __JSON_HANDLER_H_
+#define __JSON_HANDLER_H_
+
+#include <string_view>
+
+// Events the grammar reports while parsing, in document order.
+// Install one in ParseContext::Handler to observe the records without walking (or even building) the DOM.
+// Every callback does nothing by default so handlers only override what they need.
+//
+// Strings and keys are the raw token text (without quotes), escapes are NOT decoded.
+// The views are only valid until the record ends.
+struct JsonHandler {
+    virtual ~JsonHandler() {}
+
+    virtual void StartObject() {}
+    virtual void EndObject() {}
+    virtual void StartArray() {}
+    virtual void EndArray() {}
+
+    // The name of the member whose value follows.
+    virtual void Key(std::string_view /*name*/) {}
+
+    virtual void String(std::string_view /*text*/) {}
+    virtual void Int(long long /*value*/) {}
+    virtual void Float(double /*value*/) {}
+    // An integer outside the int64 range, only with ParseSettings::KeepBigInts (otherwise it is a Float).
+    virtual void BigInt(std::string_view /*digits*/) {}
+    virtual void Bool(bool /*value*/) {}
+    virtual void Null() {}
+
+    // A top level value is done and was (or was not) accepted as a valid outer object.
+    virtual void EndRecord(bool /*accepted*/) {}
+};
+
+#endif //__JSON_HANDLER_H_
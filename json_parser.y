@@ -1,18 +1,16 @@
 
 %{
-#include "flex_util.h"
-#include "json_classes.h"
+#include "parse_context.h"
+#include "ingest.h"
+#include "mapped_file.h"
+#include "compressed_input.h"
+#include "hashtag_stats.h"
 
 #include <stdio.h>
 #include <math.h>
+#include <thread>
 #include <iostream>
-void yyerror(const char *);
-extern FILE *yyin;
-extern FILE *yyout;
-extern int yylex();
-extern int yyparse();
-
-JsonDB database;
+#include <signal.h>
 
 #define ALLOWED_TEXT_LEN 140
 
@@ -21,14 +19,83 @@ JsonDB database;
 #define ALLOWED_FULLTEXT_LEN 800
 
 #define DBG(TEXT) std::cerr << "# " << TEXT << "\n";
+
+// Reports an event to the handler of the parse and to its tape, if there are.
+#define EMIT(EVENT) if (ctx->Handler) { ctx->Handler->EVENT; } if (ctx->Tape) { ctx->Tape->EVENT; }
+
+// Same for a "text" or "full_text" string, the tape keeps the JString the grammar decoded and checked.
+#define EMIT_TEXT(TOKEN, STR) if (ctx->Handler) { ctx->Handler->String((TOKEN).View()); } if (ctx->Tape) { ctx->Tape->Text(STR); }
+
+// A node of the tree. Tape parses build no nodes at all (null), the checks look at the tape instead.
+#define NODE(EXPR) (ctx->Tape ? nullptr : (EXPR))
+
+// Adds a member to an object. Validation only parses keep nothing but the special members (generic ones are null),
+// skipped members (see ProjectToken) and tape parses have null members.
+#define ADD_MEMBER(OBJECT, MEMBER) \
+    if (!(MEMBER)) {} \
+    else if (!ctx->Settings.SpecialMembersOnly()) { (OBJECT)->AddMember(MEMBER); } \
+    else { (OBJECT)->SetSpecialMember(MEMBER); }
+
+// The stack only grows with nesting (see ParseSettings::MaxDepth) which is limited by the lexer way before this.
+#define YYMAXDEPTH 1000000
 %}
 
-%error-verbose
+%define parse.error verbose
+
+// Pure parser: all state lives in the ParseContext and the (reentrant) flex scanner passed to yyparse.
+%define api.pure full
+%parse-param {ParseContext* ctx}
+%parse-param {void* scanner}
+%lex-param {void* scanner}
+
+%code requires {
+struct ParseContext;
+}
+
+%code provides {
+// Token of a quoted string by its content: the F_* token of a special field key, otherwise STRING.
+// (Both lexers use this after ruling out D_ID_STR and D_DATE.)
+inline int StringToken(std::string_view content) {
+#define SCHEMA_TOKEN(Name, Key, Token, Kind) Token,
+    static const int Tokens[] = { SCHEMA_KEYWORDS(SCHEMA_TOKEN) };
+#undef SCHEMA_TOKEN
+    const schema::Key* key = schema::Find(content);
+    return key ? Tokens[key - schema::Keys] : STRING;
+}
+
+// Token of a number that was just matched, 'integer' when it is only (signed) digits.
+// Integers outside the int64 range are read as doubles (FLOAT), or kept as BIG_INT with Settings.KeepBigInts.
+inline int NumberToken(ParseContext& ctx, const char* text, size_t length, bool integer, YYSTYPE* lval) {
+    if (integer) {
+        if (util::MakeInt(text, length, lval->AsInteger)) {
+            return text[0] == '-' ? NEG_INT : POS_INT;
+        }
+        if (ctx.Settings.KeepBigInts) {
+            lval->AsText = ctx.TokenText(text, length);
+            return BIG_INT;
+        }
+    }
+    lval->AsFloat = util::MakeDouble(text, length);
+    return FLOAT;
+}
+}
+
+%code {
+int yylex(YYSTYPE* lvalp, void* scanner);
+void yyerror(ParseContext* ctx, void* scanner, const char* s);
+
+// The parser gets its tokens through NextToken (defined below the grammar).
+static int NextToken(YYSTYPE* lvalp, void* scanner, ParseContext* ctx);
+static int SkipRecord(ParseContext* ctx, void* scanner, YYSTYPE* lvalp);
+static bool OpensLine(int token, const ParseContext* ctx);
+static void ProjectToken(int token, const YYSTYPE* lvalp, ParseContext* ctx);
+#define yylex(LVAL, SCANNER) NextToken(LVAL, SCANNER, ctx)
+}
 
 %union {
     long long AsInteger;
-    float AsFloat;
-    char* AsText;
+    double AsFloat;
+    TextRef AsText;
     bool AsBool;
     JValue* AsJValue;
     JArray* AsJArray;
@@ -41,9 +108,12 @@ JsonDB database;
 %token <AsFloat> FLOAT
 %token <AsInteger> POS_INT
 %token <AsInteger> NEG_INT
+%token <AsText> BIG_INT
 %token <AsBool> BOOL
 %token NULL_VAL
 %token INVALID_CHARACTER
+// A whole member value that was skipped by the lexer, see ProjectToken.
+%token SKIPPED
 
 // Custom field declarations. 
 // Programmatically they are just text but we have some extra grammar for them.
@@ -79,7 +149,7 @@ JsonDB database;
 %type <AsJArray> array
 %type <AsJMember> member
 %type <AsJObject> object
-%type <AsJJson> json
+%type <AsJJson> record
 
 %type <AsJArray> values
 %type <AsJObject> members
@@ -94,188 +164,300 @@ JsonDB database;
 
 
 %%
-json: 
+json:
+    /* empty */
+    | json record
+    | json error                {
+                                  // A record was rejected while it was parsed (YYERROR or a syntax error), the reason
+                                  // was already reported. What is left of it is skipped without parsing it
+                                  // and the parse goes on with the next record.
+                                  // If the token that made it fail already starts the next one, that is kept.
+                                  ++ctx->RecordCount;
+                                  ctx->Verdict("rejected.");
+                                  EMIT(EndRecord(false));
+                                  const int Failed = ctx->FailedToken ? ctx->FailedToken : yychar;
+                                  ctx->FailedToken = 0;
+                                  const int Next = Failed == YYEOF ? YYEOF
+                                                 : OpensLine(Failed, ctx) ? Failed
+                                                 : SkipRecord(ctx, scanner, &yylval);
+                                  const bool Lookahead = Next != YYEOF;
+                                  ctx->EndRecord(false, Lookahead ? ctx->Parse.LastMatchOffset : ctx->Offset, Lookahead);
+                                  yyclearin;
+                                  yychar = Next;
+                                  yyerrok;
+                                  ctx->Projected.Reset();
+                                  ctx->Nodes.Reset();
+                                  if (Lookahead) {
+                                      // The brackets the rejected record left open don't count anymore.
+                                      ctx->Depth = Next == '{' || Next == '[' ? 1 : 0;
+                                      // It comes from the lexer directly, NextToken didn't count it.
+                                      if (ctx->Stats) {
+                                          ctx->Stats->Tokens[YYTRANSLATE(Next)].Add();
+                                      }
+                                      if (ctx->Settings.Project) {
+                                          ProjectToken(Next, &yylval, ctx);
+                                      }
+                                  }
+                                  if (ctx->SingleRecord) {
+                                      YYACCEPT;
+                                  }
+                                }
+    ;
+
+record:
     value                       { 
-                                  //DBG("JSON PARSED") 
-                                  $$ = new JJson($1); 
-                                  $$->Print(std::cout);
+                                  //DBG("RECORD PARSED") 
+                                  // Every top level value is a record. A file with a single tweet is just a stream of 1.
+                                  // The database outlives the record so duplicate ids are detected across records too.
+                                  ++ctx->RecordCount;
+                                  $$ = NODE(ctx->New<JJson>($1));
+                                  if (!ctx->Settings.ValidateOnly && !ctx->Settings.SkipPrint && ctx->Settings.PrintsRecords()) {
+                                      StatScope timer(ctx->Stats, StatTimer::Print);
+                                      if (ctx->Tape) {
+                                          ctx->Tape->Root().Print(ctx->Writer, 0);
+                                          ctx->Writer.EndRecord();
+                                      }
+                                      else {
+                                          $$->Print(ctx->Writer);
+                                      }
+                                  }
                                   std::string Error = "The outer object was parsed properly but its not valid. Error was:\n";
-                                  if (!$1->Data.ObjectData->FormsValidOuterObject(Error)) {
-                                      parse.ReportError(Error);
-                                      YYERROR;
+                                  RejectReason Reason;
+                                  bool Accepted = false;
+                                  // Null with a tape, the record is on the tape then.
+                                  const JObject* Tweet = ctx->Tape || $1->Type != JValueType::Object ? nullptr : $1->Data.ObjectData;
+                                  if (ctx->Tape ? ctx->Tape->Root().Type() != TapeType::ObjectStart : !Tweet) {
+                                      ctx->Reject(RejectReason::NotAnObject, "Records must be objects.");
+                                      ctx->Verdict("rejected.");
+                                  }
+                                  else if (ctx->Settings.SkipChecks) {
+                                      ctx->CommitIds();
+                                      Accepted = true;
+                                      ++ctx->AcceptedCount;
+                                      ctx->Verdict("accepted unchecked.");
+                                  }
+                                  else if (!ctx->CheckRecord(Tweet, Error, Reason)) {
+                                      ctx->Reject(Reason, Error);
+                                      ctx->Verdict("rejected.");
                                   }
                                   else {
-                                      std::cout << "Input was a complete and valid outer object.\n";
+                                      Accepted = true;
+                                      ++ctx->AcceptedCount;
+                                      ctx->Verdict("Input was a complete and valid outer object.");
+                                      if (ctx->Settings.Project && !ctx->Settings.SkipPrint) {
+                                          StatScope timer(ctx->Stats, StatTimer::Print);
+                                          ctx->Settings.Project->WriteRow(*Tweet, ctx->Writer);
+                                      }
+                                      if (ctx->Settings.Columnar) {
+                                          ctx->AddColumns(*Tweet);
+                                      }
+                                      if (ctx->Settings.Hashtags) {
+                                          ctx->AddHashtags(Tweet);
+                                      }
+                                  }
+                                  EMIT(EndRecord(Accepted));
+                                  // With a lookahead the record ends where that token (the next record) begins.
+                                  const bool Lookahead = yychar != YYEMPTY;
+                                  ctx->EndRecord(Accepted, Lookahead ? ctx->Parse.LastMatchOffset : ctx->Offset, Lookahead);
+
+                                  // The record is done, reclaim all of its nodes. 
+                                  // If the parser already read the lookahead token its text lives in the arena too,
+                                  // in that case this record is reclaimed along with the next one.
+                                  if (!Lookahead) {
+                                      ctx->Nodes.Reset();
+                                  }
+                                  if (ctx->SingleRecord) {
+                                      YYACCEPT;
                                   }
                                 }
     ;
 
 value:
-    object                      { $$ = new JValue($1); }
-    | array                     { $$ = new JValue($1); }
-    | STRING                    { $$ = new JValue($1); }
-    | FLOAT                     { $$ = new JValue($1); }
-    | POS_INT                   { $$ = new JValue($1); }
-    | NEG_INT                   { $$ = new JValue($1); }
-    | BOOL                      { $$ = new JValue($1); }
-    | NULL_VAL                  { $$ = new JValue();   }
-    | D_DATE                    { $$ = new JValue($1); }
-    | D_ID_STR                  { $$ = new JValue($1); }
-    | special_asvalues          { $$ = new JValue($1); }
+    object                      { $$ = NODE(ctx->New<JValue>($1)); }
+    | array                     { $$ = NODE(ctx->New<JValue>($1)); }
+    | STRING                    { EMIT(String($1.View())); $$ = NODE(ctx->GenericString($1)); }
+    | FLOAT                     { EMIT(Float($1));         $$ = NODE(ctx->New<JValue>($1)); }
+    | POS_INT                   { EMIT(Int($1));           $$ = NODE(ctx->New<JValue>($1)); }
+    | NEG_INT                   { EMIT(Int($1));           $$ = NODE(ctx->New<JValue>($1)); }
+    | BIG_INT                   { EMIT(BigInt($1.View())); $$ = NODE(ctx->New<JValue>(JValue::BigInt($1))); }
+    | BOOL                      { EMIT(Bool($1));          $$ = NODE(ctx->New<JValue>($1)); }
+    | NULL_VAL                  { EMIT(Null());            $$ = NODE(ctx->New<JValue>()); }
+    | D_DATE                    { EMIT(String($1.View())); $$ = NODE(ctx->GenericString($1)); }
+    | D_ID_STR                  { EMIT(String($1.View())); $$ = NODE(ctx->GenericString($1)); }
+    | special_asvalues          { EMIT(String($1.View())); $$ = NODE(ctx->GenericString($1)); }
     ;
 
 object:
-    '{' members '}'             { 
+    object_open members '}'     { 
+                                    EMIT(EndObject());
                                     $$ = $2;
                                 }
-    | '{' '}'                   { $$ = new JObject(); }
+    | object_open '}'           { EMIT(EndObject()); $$ = NODE(ctx->New<JObject>(ctx->Nodes)); }
     ;  
 
+object_open:
+    '{'                         { EMIT(StartObject()); }
+    ;
+
+// Left recursive so the parser stack stays constant no matter how many members/values there are.
 members:
-    member                      { $$ = new JObject(); $$->AddMember($1); }
-    | member ',' members        { $$ = $3;            $$->AddMember($1); }
+    member                      { $$ = NODE(ctx->New<JObject>(ctx->Nodes)); ADD_MEMBER($$, $1); }
+    | members ',' member        { $$ = $1;                                ADD_MEMBER($$, $3); }
     ;
 
 member:
-    STRING ':' value            { $$ = new JMember($1, $3); }
+    STRING key_sep value        { $$ = ctx->Settings.SpecialMembersOnly() ? nullptr : NODE(ctx->New<JMember>($1, $3, schema::FindMember($1.View()))); }
+    | STRING key_sep SKIPPED    { $$ = nullptr; }
     | special_member            { $$ = $1; }   
     ;
 
+// The ':' after a member name. Reports the name before the value is parsed ($0 is the name token).
+key_sep:
+    ':'                         { EMIT(Key($<AsText>0.View())); }
+    ;
+
 array:
-    '[' values ']'              { $$ = $2; }
-    | '[' ']'                   { $$ = new JArray(); }
+    array_open values ']'       { EMIT(EndArray()); $$ = $2; }
+    | array_open ']'            { EMIT(EndArray()); $$ = NODE(ctx->New<JArray>(ctx->Nodes)); }
+    ;
+
+array_open:
+    '['                         { EMIT(StartArray()); }
     ;
 
 values:
-    value                       { $$ = new JArray(); $$->AddValue($1); }
-    | value ',' values          { $$ = $3;           $$->AddValue($1); }
+    value                       { $$ = NODE(ctx->New<JArray>(ctx->Nodes)); if ($$) { $$->AddValue($1); } }
+    | values ',' value          { $$ = $1;                                     if ($$) { $$->AddValue($3); } }
     ;
 
 special_intrange: 
     '[' POS_INT ',' POS_INT ']' { 
+                                    EMIT(StartArray()); EMIT(Int($2)); EMIT(Int($4)); EMIT(EndArray());
                                     if ($2 > $4) {
-                                        parse.ReportError("In the range ending here: Begin > End.");
+                                        ctx->Reject(RejectReason::InvalidRange, "In the range ending here: Begin > End.");
                                         YYERROR;
                                     }
-                                    $$ = new JArray($2, $4); 
+                                    $$ = NODE(ctx->New<JArray>(ctx->Nodes, $2, $4));
                                 }
     ;
 
 special_member:
-    F_ID_STR ':' D_ID_STR       { 
-                                    if (database.MaybeInsertIdStr($3)) {
-                                        $$ = new JMember($1, new JValue($3), JSpecialMember::IdStr); 
+    F_ID_STR key_sep D_ID_STR   {
+                                    EMIT(String($3.View()));
+                                    // Windowed ids are checked once the whole record (and its created_at) is known.
+                                    if (ctx->Database->Windowed() || ctx->StageIdStr($3.View())) {
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->NewString($3), JSpecialMember::IdStr));
                                     }
                                     else {
-                                        parse.ReportError("ID String already exists.");
+                                        ctx->Reject(RejectReason::DuplicateIdStr, "ID String already exists.");
                                         YYERROR;
                                     }
                                 }
-    | F_TEXT ':' STRING         { 
-                                    JString* str = new JString($3);
-                                    if (str->Length <= ALLOWED_TEXT_LEN) {
-                                        $$ = new JMember($1, new JValue(str), JSpecialMember::Text); 
+    | F_TEXT key_sep STRING     {
+                                    JString* str = ctx->New<JString>(ctx->Nodes, $3);
+                                    EMIT_TEXT($3, str);
+                                    if (!str->ValidUtf8) {
+                                        ctx->Reject(RejectReason::InvalidUtf8, "Invalid UTF-8 in text.");
+                                        YYERROR;
+                                    }
+                                    else if (str->Length <= ALLOWED_TEXT_LEN) {
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>(str), JSpecialMember::Text));
                                     }
                                     else {
-                                        parse.ReportError("This text field is too long.");
-                                        std::cout << "Length: " << str->Text.length() << "/142\n";
+                                        ctx->Reject(RejectReason::TextTooLong, "This text field is too long.");
+                                        *ctx->Parse.Err << "Length: " << str->Length << "/" << ALLOWED_TEXT_LEN << "\n";
                                         YYERROR;
                                     }
                                 }
-    | F_CREATEDAT ':' D_DATE    { $$ = new JMember($1, new JValue($3), JSpecialMember::CreatedAt); }
-    | F_UNAME ':' STRING        { $$ = new JMember($1, new JValue($3), JSpecialMember::UName); }
-    | F_USCREEN ':' STRING      { $$ = new JMember($1, new JValue($3), JSpecialMember::UScreenName); }
-    | F_ULOCATION ':' STRING    { $$ = new JMember($1, new JValue($3), JSpecialMember::ULocation); }
-    | F_UID ':' POS_INT         { 
-                                    if (database.MaybeInsertUserId($3)) {
-                                        $$ = new JMember($1, new JValue($3), JSpecialMember::UId); 
+    | F_CREATEDAT key_sep D_DATE { EMIT(String($3.View())); $$ = NODE(ctx->New<JMember>($1, ctx->NewString($3), JSpecialMember::CreatedAt)); }
+    | F_UNAME key_sep STRING    { EMIT(String($3.View())); $$ = NODE(ctx->New<JMember>($1, ctx->NewString($3), JSpecialMember::UName)); }
+    | F_USCREEN key_sep STRING  { EMIT(String($3.View())); $$ = NODE(ctx->New<JMember>($1, ctx->NewString($3), JSpecialMember::UScreenName)); }
+    | F_ULOCATION key_sep STRING { EMIT(String($3.View())); $$ = NODE(ctx->New<JMember>($1, ctx->NewString($3), JSpecialMember::ULocation)); }
+    | F_UID key_sep POS_INT     {
+                                    EMIT(Int($3));
+                                    if (ctx->Database->Windowed() || ctx->StageUserId($3)) {
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::UId));
                                     }
                                     else {
-                                        parse.ReportError("User ID already exists.");
+                                        ctx->Reject(RejectReason::DuplicateUserId, "User ID already exists.");
                                         YYERROR;
                                     }
                                 }
-    | F_USER ':' object         { 
-                                    if ($3->Members.FormsValidUser(false)) {
-                                        $$ = new JMember($1, new JValue($3), JSpecialMember::User);
+    | F_USER key_sep object     { 
+                                    if (ctx->Tape ? ctx->Tape->LastClosed().AsObject().FormsValidUser() : $3->Members.FormsValidUser(false)) {
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::User));
                                     }
                                     else {
-                                        parse.ReportError("User ending here is missing fields. "
+                                        ctx->Reject(RejectReason::InvalidUser, "User ending here is missing fields. "
                                                           "All user objects must atleast include screen_name.");
                                         YYERROR;
                                     }
                                 }
-    | F_RT_STATUS ':' object    {
-                                    // A "retweet_status" does not always need a "tweet" object.
-                                    // but MUST have text and valid User Object
-                                    if (!$3->Members.Text || !$3->Members.User) {
-                                        parse.ReportError("Retweet status object ending here is invalid. "
-                                                          "It is missing 'text' and/or 'user' field." );
+    | F_RT_STATUS key_sep object {
+                                    std::string Error = "Retweet status object ending here is invalid. ";
+                                    if (ctx->Tape ? !ctx->Tape->LastClosed().AsObject().FormsValidRetweetStatus(Error) : !$3->FormsValidRetweetStatus(Error)) {
+                                        ctx->Reject(RejectReason::InvalidRetweet, Error);
                                         YYERROR;
                                     }
-
-                                    // if there is a 'tweet' object we need to verify the username from RT @
-                                    if ($3->Members.TweetObj) {
-                                        
-                                        // "user"->"ScreenName"->Text
-                                        const std::string& OriginalTweetAuthor = $3->Members.User->Members.UScreenName->Text; 
-
-                                        // "tweet"->"text" [@User]
-                                        const std::string& RetweetAtFound = $3->Members.TweetObj->Members.Text->RetweetUser; 
-                                        
-                                        if (OriginalTweetAuthor != RetweetAtFound) { 
-                                            parse.ReportError("Retweet status object ending here is invalid. RT @ user '" + RetweetAtFound 
-                                                            + "' is not the same as the original tweet user. '" + OriginalTweetAuthor + "'");
-                                            YYERROR;
-                                        }
-                                    }
                                     // this will only run if no YYERROR was run.
-                                    $$ = new JMember($1, new JValue($3));
+                                    $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3)));
                                 }
-    | F_RT_TWEET ':' object     {
-                                    if ($3->FormsValidRetweetObj()) {
-                                        $$ = new JMember($1, new JValue($3), JSpecialMember::TweetObj);
+    | F_RT_TWEET key_sep object {
+                                    if (ctx->Tape ? ctx->Tape->LastClosed().AsObject().FormsValidRetweetObj() : $3->FormsValidRetweetObj()) {
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::TweetObj));
                                     }
                                     else {
-                                        parse.ReportError("Tweet object ending here is invalid. "
+                                        ctx->Reject(RejectReason::InvalidRetweet, "Tweet object ending here is invalid. "
                                                           "Tweet objects require 'text' field starting with 'RT @Username', and a valid 'user'.");
                                         YYERROR;
                                     }
                                 }
-    | F_ET_DECLARATION ':' object   { 
+    | F_ET_DECLARATION key_sep object { 
                                         std::string Error = "Extended tweet object ending here is invalid: ";
-                                        if (!$3->FormsValidExtendedTweetObj(Error)) {
-                                            parse.ReportError(Error);
+                                        bool Valid;
+                                        {
+                                            StatScope timer(ctx->Stats, StatTimer::Checks);
+                                            Valid = ctx->Tape ? ctx->Tape->LastClosed().AsObject().FormsValidExtendedTweetObj(Error)
+                                                              : $3->FormsValidExtendedTweetObj(Error);
+                                        }
+                                        if (!Valid) {
+                                            ctx->Reject(RejectReason::InvalidExtendedTweet, Error);
                                             YYERROR;
                                         }
-                                        $$ = new JMember($1, new JValue($3), JSpecialMember::ExTweet); 
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::ExTweet));
                                     }
-    | F_ET_TRUNC ':' BOOL           { $$ = new JMember($1, new JValue($3), JSpecialMember::Truncated); }
-    | F_ET_DISPLAYRANGE ':' special_intrange { $$ = new JMember($1, new JValue($3), JSpecialMember::DisplayRange); }
-    | F_ET_ENTITIES ':' object      { 
-                                        if (!$3->ExMembers.Hashtags) {
-                                            parse.ReportError("Entities object ending here is missing a 'hashtags' member.");
+    | F_ET_TRUNC key_sep BOOL       { EMIT(Bool($3)); $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::Truncated)); }
+    | F_ET_DISPLAYRANGE key_sep special_intrange { $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::DisplayRange)); }
+    | F_ET_ENTITIES key_sep object  { 
+                                        if (ctx->Tape ? !TapeSpecialMembers(ctx->Tape->LastClosed().AsObject()).Hashtags : !$3->ExMembers.Hashtags) {
+                                            ctx->Reject(RejectReason::InvalidEntities, "Entities object ending here is missing a 'hashtags' member.");
                                             YYERROR;
                                         }
-                                        $$ = new JMember($1, new JValue($3), JSpecialMember::Entities); 
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::Entities));
                                     }
-    | F_ET_HASHTAGS ':' array       { 
+    | F_ET_HASHTAGS key_sep array   { 
                                         std::string Error = "Array ending here is not a valid hastags array: ";
-                                        bool IsValidArray = $3->ExtractHashtags(Error);
+                                        bool IsValidArray = ctx->Tape ? ctx->Tape->LastClosed().AsArray().ExtractHashtags(nullptr, Error)
+                                                                      : $3->ExtractHashtags(Error);
                                         if (!IsValidArray) {
-                                            parse.ReportError(Error);
+                                            ctx->Reject(RejectReason::InvalidEntities, Error);
                                             YYERROR;
                                         }
-                                        $$ = new JMember($1, new JValue($3), JSpecialMember::Hashtags); 
+                                        $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::Hashtags));
                                     }
-    | F_ET_INDICES ':' special_intrange { $$ = new JMember($1, new JValue($3), JSpecialMember::Indices); }
-    | F_ET_FULLTEXT ':' STRING      { 
-                                        JString* str = new JString($3);
-                                        if (str->Length <= ALLOWED_FULLTEXT_LEN) {
-                                            $$ = new JMember($1, new JValue(str), JSpecialMember::FullText); 
+    | F_ET_INDICES key_sep special_intrange { $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>($3), JSpecialMember::Indices)); }
+    | F_ET_FULLTEXT key_sep STRING  {
+                                        JString* str = ctx->New<JString>(ctx->Nodes, $3);
+                                        EMIT_TEXT($3, str);
+                                        if (!str->ValidUtf8) {
+                                            ctx->Reject(RejectReason::InvalidUtf8, "Invalid UTF-8 in 'full_text'.");
+                                            YYERROR;
+                                        }
+                                        else if (str->Length <= ALLOWED_FULLTEXT_LEN) {
+                                            $$ = NODE(ctx->New<JMember>($1, ctx->New<JValue>(str), JSpecialMember::FullText));
                                         }
                                         else {
-                                            parse.ReportError("'full_text' is too long: " + std::to_string(str->Length) +
+                                            ctx->Reject(RejectReason::TextTooLong, "'full_text' is too long: " + std::to_string(str->Length) +
                                                               "/" + std::to_string(ALLOWED_FULLTEXT_LEN));
                                             YYERROR;
                                         }
@@ -304,26 +486,573 @@ special_asvalues:
 
 %%
 
-void yyerror(const char *s) {
-    parse.ReportError(s);
+void yyerror(ParseContext* ctx, void* /*scanner*/, const char *s) {
+    ctx->Reject(RejectReason::SyntaxError, s);
 }
 
-void parse_args(int argc, char **argv);
+const char* TokenKindName(int kind) {
+    return kind < YYNTOKENS ? yytname[kind] : "?";
+}
 
-int main (int argc, char **argv) {
-    parse_args(argc, argv);
-    yyparse();
-    return 0;
+static_assert(YYNTOKENS <= ParseStats::TokenKinds, "ParseStats can't count every token kind.");
+
+#undef yylex
+
+// Whether a token can be the name of a member: a string that isn't a date or all digits.
+static bool IsMemberName(int token) {
+    switch (token) {
+        case STRING:
+        case F_ID_STR:
+        case F_TEXT:
+        case F_CREATEDAT:
+        case F_USER:
+        case F_UNAME:
+        case F_USCREEN:
+        case F_ULOCATION:
+        case F_UID:
+        case F_RT_STATUS:
+        case F_RT_TWEET:
+        case F_ET_DECLARATION:
+        case F_ET_TRUNC:
+        case F_ET_DISPLAYRANGE:
+        case F_ET_ENTITIES:
+        case F_ET_HASHTAGS:
+        case F_ET_INDICES:
+        case F_ET_FULLTEXT:
+            return true;
+    }
+    return false;
+}
+
+// Whether 'token' is a '{' or '[' at the very start of a line. In newline delimited input that is where the next
+// record begins, even when a truncated (or wrongly closed) record before it left brackets open.
+// Pretty printed records indent everything they nest.
+static bool OpensLine(int token, const ParseContext* ctx) {
+    return (token == '{' || token == '[') && ctx->Parse.LastMatchOffset == ctx->Parse.LineStart;
 }
 
-void parse_args(int argc, char **argv) {
-    yyin = stdin;
-    yyout = stdout;
+// A '{' or '[' that opens a line inside a record (see OpensLine) rejects it, the token is the next record's.
+static bool CutsRecord(int token, ParseContext* ctx) {
+    if (ctx->Depth > 1 && OpensLine(token, ctx)) {
+        ctx->Reject(RejectReason::SyntaxError, "The record is not closed before the next one starts.");
+        ctx->FailedToken = token;
+        return true;
+    }
+    return false;
+}
 
-    if (argc > 1) {
-        yyin = fopen(argv[1], "r");
+// Reads the value of a member that no path of the projection goes through, only the lexer runs.
+// Returns SKIPPED for the whole value, or the token that ended it early for the grammar to reject
+// (a misplaced '}', ']', ',' or ':', an invalid character, nesting too deep or the end of the input).
+// Inside a skipped object/array the brackets and separators are checked like the grammar does, a misplaced
+// token rejects the record here (YYerror). Special member names count as any other name, their values are
+// not checked.
+static int SkipValue(YYSTYPE* lvalp, void* scanner, ParseContext* ctx) {
+    int token = yylex(lvalp, scanner);
+    switch (token) {
+        case '{':
+        case '[':
+            if (CutsRecord(token, ctx)) {
+                return YYerror;
+            }
+            break;
+        case '}':
+        case ']':
+        case ',':
+        case ':':
+        case YYEOF:
+        case YYerror:
+        case INVALID_CHARACTER:
+            return token;
+        default:
+            return SKIPPED;
     }
-    if (argc > 2) {
-        yyout = fopen(argv[2], "w");
+
+    // What may come next in the innermost open object/array.
+    enum class Next { FirstName, Name, Colon, FirstValue, Value, CommaOrClose };
+    // The open brackets, a short string doesn't allocate for the usual nesting.
+    std::string open(1, (char)token);
+    Next next = token == '{' ? Next::FirstName : Next::FirstValue;
+    while (!open.empty()) {
+        token = yylex(lvalp, scanner);
+        bool valid;
+        switch (token) {
+            case YYEOF:
+            case YYerror:
+            case INVALID_CHARACTER:
+                return token;
+            case '{':
+            case '[':
+                if (CutsRecord(token, ctx)) {
+                    return YYerror;
+                }
+                valid = next == Next::FirstValue || next == Next::Value;
+                open.push_back((char)token);
+                next = token == '{' ? Next::FirstName : Next::FirstValue;
+                break;
+            case '}':
+            case ']': {
+                const bool object = token == '}';
+                valid = open.back() == (object ? '{' : '[')
+                        && (next == Next::CommaOrClose || next == (object ? Next::FirstName : Next::FirstValue));
+                open.pop_back();
+                next = Next::CommaOrClose;
+                break;
+            }
+            case ',':
+                valid = next == Next::CommaOrClose;
+                next = open.back() == '{' ? Next::Name : Next::Value;
+                break;
+            case ':':
+                valid = next == Next::Colon;
+                next = Next::Value;
+                break;
+            default:
+                if (next == Next::FirstName || next == Next::Name) {
+                    valid = IsMemberName(token);
+                    next = Next::Colon;
+                }
+                else {
+                    valid = next == Next::FirstValue || next == Next::Value;
+                    next = Next::CommaOrClose;
+                }
+                break;
+        }
+        if (!valid) {
+            ctx->Reject(RejectReason::SyntaxError, std::string("syntax error, unexpected ") + TokenKindName(YYTRANSLATE(token)));
+            ctx->FailedToken = token;
+            return YYerror;
+        }
     }
-}
\ No newline at end of file
+    return SKIPPED;
+}
+
+// Follows a token through the member paths of the projection (Settings.Project).
+// After the ':' of a member with a STRING name that no path goes through, the next token is its skipped value.
+static void ProjectToken(int token, const YYSTYPE* lvalp, ParseContext* ctx) {
+    ProjectionCursor& cursor = ctx->Projected;
+    switch (token) {
+        case '{':
+        case '[':
+            cursor.Frames.push_back({ cursor.ValueNode(*ctx->Settings.Project), token == '[' });
+            break;
+        case '}':
+        case ']':
+            if (!cursor.Frames.empty()) {
+                cursor.Frames.pop_back();
+            }
+            break;
+        case ':':
+            if (!cursor.Frames.empty()) {
+                cursor.Member = Projection::Child(cursor.Frames.back().Node, cursor.Key.View());
+                cursor.SkipValue = !cursor.Member && cursor.GenericKey;
+            }
+            break;
+        case STRING:
+            cursor.Key = lvalp->AsText;
+            cursor.GenericKey = true;
+            break;
+        default:
+            // The F_* keys are declared in a row.
+            if (token >= F_ID_STR && token <= F_ET_FULLTEXT) {
+                cursor.Key = lvalp->AsText;
+                cursor.GenericKey = false;
+            }
+            break;
+    }
+}
+
+// Notes where records start. With stats every token is also counted by its kind and one every LexerSample is timed.
+// Projections skip the values they don't need here (see ProjectToken), and a truncated record ends where the next
+// one begins (see CutsRecord).
+static int NextToken(YYSTYPE* lvalp, void* scanner, ParseContext* ctx) {
+    ParseStats* stats = ctx->Stats;
+    int token;
+    if (ctx->Projected.SkipValue) {
+        ctx->Projected.SkipValue = false;
+        token = SkipValue(lvalp, scanner, ctx);
+    }
+    else if (stats && stats->Lexed++ % ParseStats::LexerSample == 0) {
+        StatScope timer(stats, StatTimer::Lexer);
+        token = yylex(lvalp, scanner);
+    }
+    else {
+        token = yylex(lvalp, scanner);
+    }
+    if (CutsRecord(token, ctx)) {
+        token = YYerror;
+    }
+    if (stats) {
+        stats->Tokens[YYTRANSLATE(token)].Add();
+    }
+    if (ctx->AtRecordStart) {
+        ctx->StartRecord();
+    }
+    if (ctx->Settings.Project && token != SKIPPED) {
+        ProjectToken(token, lvalp, ctx);
+    }
+    return token;
+}
+
+// Drops the tokens of the rejected record up to the one that closes its outermost object/array, or up to the
+// start of the next record (see OpensLine) when that comes first. A record on the same line follows right after
+// the closing token, anything else left of the line is the rest of the rejected one (eg: a stray '}' closed it
+// early) and is dropped too.
+// Only the lexer runs, so the rest of the record costs no grammar actions or nodes, nor reports: it is not
+// checked for depth either (see ParseContext::Skipping).
+// Returns the token that starts the next record, its value in 'lvalp', or YYEOF if the input ended first.
+static int SkipRecord(ParseContext* ctx, void* scanner, YYSTYPE* lvalp) {
+    int token = YYEMPTY;
+    ctx->Skipping = true;
+    while (ctx->Depth > 0) {
+        token = yylex(lvalp, scanner);
+        if (token == YYEOF || OpensLine(token, ctx)) {
+            break;
+        }
+        token = YYEMPTY;
+    }
+    if (token == YYEMPTY) {
+        const size_t line = ctx->Parse.LineStart;
+        token = yylex(lvalp, scanner);
+        if (token != '{' && token != '[') {
+            while (token != YYEOF && ctx->Parse.LineStart == line) {
+                token = yylex(lvalp, scanner);
+            }
+        }
+    }
+    // The depth is the caller's to set, a stray closing bracket may have taken it below 0.
+    ctx->Skipping = false;
+    return token;
+}
+
+// The benchmarks bring their own main (make bench).
+#ifndef PARSER_NO_MAIN
+
+struct ParserOptions {
+    FILE* Input = stdin;
+    FILE* Output = stdout;
+    const char* InputPath = nullptr;
+    ParseSettings Settings;
+    // Worker threads for newline delimited input files. 0 uses every core.
+    int Threads = 1;
+    // Expected number of records, pre-sizes the id database.
+    size_t ExpectedRecords = 0;
+    // Where the id database is kept between runs, none if null.
+    const char* DbPath = nullptr;
+    // New ids between checkpoints of the id database, 0 only checkpoints at exit.
+    size_t CheckpointEvery = 0;
+    // Only reject ids seen within this many seconds of created_at, 0 rejects every id seen before.
+    long long WindowSeconds = 0;
+    int WindowBuckets = 24;
+    bool WindowBloom = false;
+    // How many of the most frequent hashtags are reported, 0 doesn't count hashtags at all.
+    size_t TopHashtags = 0;
+    // Also report them per bucket of this many seconds of created_at, 0 only for the whole input.
+    long long HashtagBucketSeconds = 0;
+    // Where hashtag reports are written.
+    FILE* HashtagOutput = stderr;
+    // Count and time the run, the stats are written at exit and every StatsSeconds if > 0.
+    bool Stats = false;
+    long long StatsSeconds = 0;
+    FILE* StatsOutput = stderr;
+    // Where rejected records are written, none if null.
+    FILE* DeadLetterOutput = nullptr;
+    // Paths of the accepted records written as rows instead of the records, none if it has no columns.
+    Projection Project;
+    // Where the accepted records are written as columns instead, none if null.
+    FILE* ColumnarOutput = nullptr;
+    size_t RowGroupRows = ColumnarFile::DefaultRowGroupRows;
+};
+
+void parse_args(int argc, char **argv, ParserOptions& options);
+long long parse_duration(const char* text);
+
+int main (int argc, char **argv) {
+    ParserOptions options;
+    parse_args(argc, argv, options);
+
+    JsonDB database;
+    if (options.DbPath && !database.Open(options.DbPath, options.CheckpointEvery, std::cerr)) {
+        exit(1);
+    }
+    if (options.WindowSeconds > 0) {
+        if (options.DbPath) {
+            std::cerr << "--window can't be used with --db, windowed ids are not persisted.\n";
+            exit(1);
+        }
+        database.UseWindow(options.WindowSeconds, options.WindowBuckets, options.WindowBloom);
+    }
+    if (options.ExpectedRecords) {
+        database.Reserve(options.ExpectedRecords);
+    }
+    std::unique_ptr<HashtagStats> hashtags;
+    if (options.TopHashtags) {
+        hashtags.reset(new HashtagStats(options.TopHashtags, options.HashtagBucketSeconds));
+        hashtags->DumpTo = options.HashtagOutput;
+        options.Settings.Hashtags = hashtags.get();
+    }
+    std::unique_ptr<DeadLetterQueue> deadLetters;
+    if (options.DeadLetterOutput) {
+        deadLetters.reset(new DeadLetterQueue(options.DeadLetterOutput));
+        options.Settings.DeadLetters = deadLetters.get();
+    }
+    if (!options.Project.Columns.empty()) {
+        options.Settings.Project = &options.Project;
+        options.Settings.ValidateOnly = false;
+        JsonWriter header(options.Output, false);
+        options.Project.WriteHeader(header);
+    }
+    std::unique_ptr<ColumnarFile> columnar;
+    if (options.ColumnarOutput) {
+        columnar.reset(new ColumnarFile(options.ColumnarOutput, options.RowGroupRows));
+        options.Settings.Columnar = columnar.get();
+        // The columns only need the special members, a projection needs the rest too.
+        options.Settings.ValidateOnly = !options.Settings.Project;
+    }
+    // The tape is only for printing whole records.
+    if (options.Settings.ValidateOnly || !options.Settings.PrintsRecords()) {
+        options.Settings.UseTape = false;
+    }
+    std::unique_ptr<RunStats> stats;
+    if (options.Stats) {
+        stats.reset(new RunStats(options.StatsOutput, options.StatsSeconds));
+        options.Settings.Stats = stats.get();
+    }
+    if (hashtags || stats) {
+        // The hashtag counts so far are written by the next record that completes, the stats by their reporter.
+        signal(SIGUSR1, [](int) {
+            HashtagStats::RequestDump();
+            RunStats::RequestDump();
+        });
+    }
+    unsigned long long RecordCount = 0;
+    unsigned long long AcceptedCount = 0;
+    // False if the input could not be read or the parse stopped early.
+    bool Ok = true;
+    // Why compressed input ended early, if it did.
+    std::string InputError;
+
+    // Compressed files can't be split in chunks, they are parsed on one thread (and decompressed on another).
+    const bool compressed = MayBeCompressed(options.Input);
+    if (compressed && options.Threads != 1) {
+        std::cerr << "Compressed input is parsed on a single thread.\n";
+    }
+    // Windowed verdicts depend on the order the ids arrive in (see IdWindow), not just on which came first.
+    else if (database.Windowed() && options.Threads != 1) {
+        std::cerr << "Windowed ids are checked on a single thread.\n";
+    }
+
+    if (options.Threads != 1 && options.InputPath && !compressed && !database.Windowed()) {
+        const int threads = options.Threads > 0 ? options.Threads : std::max(1u, std::thread::hardware_concurrency());
+        IngestStats stats = IngestParallel(options.InputPath, database, options.Settings, threads, options.Output, std::cerr);
+        RecordCount = stats.RecordCount;
+        AcceptedCount = stats.AcceptedCount;
+        Ok = stats.Ok;
+    }
+    else {
+        ParseContext ctx(&database, options.Settings, options.Output);
+        MappedFile file;
+        // Scan regular files in place, fall back to streaming for stdin and pipes.
+        // Compressed input is decompressed straight from the mapping (or the stream) on a thread of its own.
+        if (options.InputPath && file.Open(options.InputPath)) {
+            if (DetectCompression(file.Data, file.Length) != Compression::None) {
+                CompressedInput input(file.Data, file.Length);
+                Ok = ParseCompressed(ctx, input) == 0;
+                InputError = input.Error();
+            }
+            else {
+                Ok = ParseBuffer(ctx, file.Data, file.Length) == 0;
+            }
+        }
+        else if (compressed) {
+            CompressedInput input(options.Input);
+            Ok = ParseCompressed(ctx, input) == 0;
+            InputError = input.Error();
+        }
+        else {
+            Ok = ParseFile(ctx, options.Input) == 0;
+        }
+        ctx.Writer.Flush();
+        if (columnar) {
+            columnar->Add(ctx.Columns);
+        }
+        RecordCount = ctx.RecordCount;
+        AcceptedCount = ctx.AcceptedCount;
+    }
+    fflush(options.Output);
+    database.Close(std::cerr);
+    if (hashtags) {
+        hashtags->Dump(options.HashtagOutput);
+    }
+    if (stats) {
+        stats->Dump();
+    }
+    if (deadLetters) {
+        deadLetters->Flush();
+    }
+    if (columnar && !columnar->Close()) {
+        std::cerr << "Could not write the columnar output.\n";
+    }
+    if (!InputError.empty()) {
+        std::cerr << "The input could not be decompressed completely: " << InputError << "\n";
+    }
+
+    // Rows may be going to stdout.
+    std::ostream& summary = options.Settings.Project ? std::cerr : std::cout;
+    summary << "Parsed " << RecordCount << " record(s), " << AcceptedCount << " valid, "
+              << RecordCount - AcceptedCount << " rejected.\n";
+    return Ok && InputError.empty() ? 0 : 1;
+}
+
+// Usage: parser [-j threads] [--max-depth N] [--compact] [--validate] [--big-ints] [--expect records]
+//               [--db path [--checkpoint-every ids]] [--window duration [--window-buckets N] [--bloom]]
+//               [--hashtags K [--hashtag-buckets duration] [--hashtags-out path]]
+//               [--stats [--stats-every duration] [--stats-out path]] [--dead-letters path]
+//               [--project path,path... [--csv]] [--columnar path [--row-group rows]] [--tape]
+//               [input [output]]
+// The input may be gzip compressed, or zstd with a parser built with ZSTD=1 (found by their magic bytes).
+// Durations are seconds or a number with a s/m/h/d suffix (eg: 72h).
+void parse_args(int argc, char **argv, ParserOptions& options) {
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if ((arg == "-j" || arg == "--threads") && i + 1 < argc) {
+            options.Threads = atoi(argv[++i]);
+        }
+        else if (arg == "--compact") {
+            options.Settings.Compact = true;
+        }
+        else if (arg == "--validate") {
+            options.Settings.ValidateOnly = true;
+        }
+        else if (arg == "--expect" && i + 1 < argc) {
+            options.ExpectedRecords = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--db" && i + 1 < argc) {
+            options.DbPath = argv[++i];
+        }
+        else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            options.CheckpointEvery = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--window" && i + 1 < argc) {
+            options.WindowSeconds = parse_duration(argv[++i]);
+            if (options.WindowSeconds <= 0) {
+                std::cerr << "Invalid window '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--window-buckets" && i + 1 < argc) {
+            options.WindowBuckets = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--bloom") {
+            options.WindowBloom = true;
+        }
+        else if (arg == "--hashtags" && i + 1 < argc) {
+            options.TopHashtags = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--hashtag-buckets" && i + 1 < argc) {
+            options.HashtagBucketSeconds = parse_duration(argv[++i]);
+            if (options.HashtagBucketSeconds <= 0) {
+                std::cerr << "Invalid hashtag bucket '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--hashtags-out" && i + 1 < argc) {
+            options.HashtagOutput = fopen(argv[++i], "w");
+            if (!options.HashtagOutput) {
+                std::cerr << "Could not open hashtag output file '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--stats") {
+            options.Stats = true;
+        }
+        else if (arg == "--stats-every" && i + 1 < argc) {
+            options.StatsSeconds = parse_duration(argv[++i]);
+            if (options.StatsSeconds <= 0) {
+                std::cerr << "Invalid stats interval '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--stats-out" && i + 1 < argc) {
+            options.StatsOutput = fopen(argv[++i], "w");
+            if (!options.StatsOutput) {
+                std::cerr << "Could not open stats output file '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--dead-letters" && i + 1 < argc) {
+            options.DeadLetterOutput = fopen(argv[++i], "w");
+            if (!options.DeadLetterOutput) {
+                std::cerr << "Could not open dead letter file '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--project" && i + 1 < argc) {
+            if (!options.Project.Add(argv[++i])) {
+                std::cerr << "Invalid projection '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--csv") {
+            options.Project.Delimited = Projection::Format::Csv;
+        }
+        else if (arg == "--columnar" && i + 1 < argc) {
+            options.ColumnarOutput = fopen(argv[++i], "wb");
+            if (!options.ColumnarOutput) {
+                std::cerr << "Could not open columnar output file '" << argv[i] << "'.\n";
+                exit(1);
+            }
+        }
+        else if (arg == "--row-group" && i + 1 < argc) {
+            options.RowGroupRows = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--tape") {
+            options.Settings.UseTape = true;
+        }
+        else if (arg == "--big-ints") {
+            options.Settings.KeepBigInts = true;
+        }
+        else if (arg == "--max-depth" && i + 1 < argc) {
+            char* end;
+            const long depth = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end || depth < 1) {
+                std::cerr << "Invalid max depth '" << argv[i] << "', it must be 1 or more.\n";
+                exit(1);
+            }
+            options.Settings.MaxDepth = (int)std::min(depth, (long)ParseSettings::MaxAllowedDepth);
+        }
+        else if (positional == 0) {
+            options.InputPath = argv[i];
+            options.Input = fopen(argv[i], "r");
+            if (!options.Input) {
+                std::cerr << "Could not open input file '" << argv[i] << "'.\n";
+                exit(1);
+            }
+            ++positional;
+        }
+        else if (positional == 1) {
+            options.Output = fopen(argv[i], "w");
+            if (!options.Output) {
+                std::cerr << "Could not open output file '" << argv[i] << "'.\n";
+                exit(1);
+            }
+            ++positional;
+        }
+    }
+}
+
+long long parse_duration(const char* text) {
+    char* end;
+    const long long value = strtoll(text, &end, 10);
+    switch (*end) {
+        case '\0':
+        case 's': return value;
+        case 'm': return value * 60;
+        case 'h': return value * 3600;
+        case 'd': return value * 86400;
+    }
+    return -1;
+}
+
+#endif // PARSER_NO_MAIN
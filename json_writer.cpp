@@ -0,0 +1,139 @@
+#include "json_writer.h"
+
+#include <charconv>
+#include <cmath>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const char Spaces[] = "                                                                ";
+
+// Escape sequence for every byte that needs one, 0 if the byte is written as is.
+// Other control characters without a short form use \u00XX.
+char ShortEscape(unsigned char c) {
+    switch (c) {
+        case '"':  return '"';
+        case '\\': return '\\';
+        case '\n': return 'n';
+        case '\r': return 'r';
+        case '\t': return 't';
+        case '\b': return 'b';
+        case '\f': return 'f';
+    }
+    return 0;
+}
+
+bool NeedsEscape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Returns the length of the prefix of 'text' that can be copied without escaping.
+size_t PlainPrefix(const char* text, size_t length) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // Check 16 bytes at a time for '"', '\' or anything <= 0x1F.
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= length; i += 16) {
+        const __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+        const __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(block, control), control));
+        const int mask = _mm_movemask_epi8(special);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < length; ++i) {
+        if (NeedsEscape(text[i])) {
+            return i;
+        }
+    }
+    return length;
+}
+
+} // namespace
+
+void JsonWriter::WriteRawString(std::string_view text) {
+    Buffer.push_back('"');
+    Buffer.append(text.data(), text.length());
+    Buffer.push_back('"');
+}
+
+void JsonWriter::WriteString(std::string_view text) {
+    Buffer.push_back('"');
+
+    const char* data = text.data();
+    size_t length = text.length();
+    while (length) {
+        // Copy the longest run that needs no escaping in one go.
+        const size_t plain = PlainPrefix(data, length);
+        Buffer.append(data, plain);
+        if (plain == length) {
+            break;
+        }
+
+        const unsigned char c = data[plain];
+        const char escape = ShortEscape(c);
+        if (escape) {
+            const char sequence[2] = { '\\', escape };
+            Buffer.append(sequence, 2);
+        }
+        else {
+            static const char Hex[] = "0123456789abcdef";
+            const char sequence[6] = { '\\', 'u', '0', '0', Hex[c >> 4], Hex[c & 0xF] };
+            Buffer.append(sequence, 6);
+        }
+
+        data += plain + 1;
+        length -= plain + 1;
+    }
+
+    Buffer.push_back('"');
+    MaybeFlush();
+}
+
+void JsonWriter::WriteInt(long long value) {
+    char digits[24];
+    const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+    Buffer.append(digits, result.ptr - digits);
+}
+
+void JsonWriter::WriteFloat(double value) {
+    if (!std::isfinite(value)) {
+        // JSON has no infinity nor NaN (eg: 1e400 reads as infinity).
+        Buffer.append("null");
+        return;
+    }
+    // Shortest representation that reads back as the same value.
+    char digits[32];
+    const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+    Buffer.append(digits, result.ptr - digits);
+}
+
+void JsonWriter::NewLine(int indentation) {
+    if (!Pretty) {
+        return;
+    }
+    Buffer.push_back('\n');
+
+    size_t spaces = indentation * 2;
+    while (spaces) {
+        const size_t count = spaces < sizeof(Spaces) - 1 ? spaces : sizeof(Spaces) - 1;
+        Buffer.append(Spaces, count);
+        spaces -= count;
+    }
+}
+
+void JsonWriter::Flush() {
+    if (Out && Buffer.size()) {
+        fwrite(Buffer.data(), 1, Buffer.size(), Out);
+        Buffer.clear();
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef __JSON_WRITER_H_
+#define __JSON_WRITER_H_
+
+#include <stdio.h>
+#include <string>
+#include <string_view>
+
+// Buffered JSON output.
+// Everything is appended to an in memory buffer that is written to 'Out' in big blocks.
+// Without an 'Out' file the buffer just keeps growing and the caller collects it with Take().
+struct JsonWriter {
+    static const size_t FlushThreshold = 64 * 1024;
+
+    // Pretty output has one value per line and 2 space indentation, compact output has no whitespace at all.
+    bool Pretty;
+
+    JsonWriter(FILE* out, bool pretty = true)
+        : Pretty(pretty)
+        , Out(out) {
+        Buffer.reserve(FlushThreshold * 2);
+    }
+
+    ~JsonWriter() {
+        Flush();
+    }
+
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator=(const JsonWriter&) = delete;
+
+    void Write(std::string_view text) {
+        Buffer.append(text.data(), text.length());
+        MaybeFlush();
+    }
+
+    void Put(char c) {
+        Buffer.push_back(c);
+    }
+
+    // Writes text that is already valid string content (eg: raw token text) in quotes.
+    void WriteRawString(std::string_view text);
+
+    // Writes text in quotes, escaping what JSON requires.
+    void WriteString(std::string_view text);
+
+    void WriteInt(long long value);
+    // null for infinities and NaN.
+    void WriteFloat(double value);
+
+    // Line break and indentation for the next item of a container, nothing in compact mode.
+    void NewLine(int indentation);
+
+    // Separator between a member name and its value.
+    void KeySeparator() {
+        Buffer.append(Pretty ? ": " : ":");
+    }
+
+    // Ends a top level value. Records are always on their own line(s).
+    void EndRecord() {
+        Buffer.push_back('\n');
+        MaybeFlush();
+    }
+
+    void Flush();
+
+    // Bytes written and not flushed (or taken) yet.
+    size_t Buffered() const {
+        return Buffer.size();
+    }
+
+    // Returns and clears everything written so far (used when there is no 'Out' file).
+    std::string Take() {
+        std::string taken;
+        taken.swap(Buffer);
+        return taken;
+    }
+
+private:
+    void MaybeFlush() {
+        if (Out && Buffer.size() >= FlushThreshold) {
+            Flush();
+        }
+    }
+
+    FILE* Out;
+    std::string Buffer;
+};
+
+#endif //__JSON_WRITER_H_
@@ -0,0 +1,60 @@
+#ifndef __MAPPED_FILE_H_
+#define __MAPPED_FILE_H_
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+
+// Read only memory mapping of a whole file. 
+// Lets the scanner read the input in place and the tokens point straight into it.
+struct MappedFile {
+    const char* Data = nullptr;
+    size_t Length = 0;
+
+    MappedFile() {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (Data && Length) {
+            munmap((void*)Data, Length);
+        }
+    }
+
+    // Returns false if the file can't be opened or mapped (eg: pipes), an empty file maps to an empty buffer.
+    bool Open(const char* path) {
+        const int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+            close(fd);
+            return false;
+        }
+
+        Length = info.st_size;
+        if (Length == 0) {
+            close(fd);
+            Data = "";
+            return true;
+        }
+
+        void* mapped = mmap(nullptr, Length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            Length = 0;
+            return false;
+        }
+
+        madvise(mapped, Length, MADV_SEQUENTIAL);
+        Data = (const char*)mapped;
+        return true;
+    }
+};
+
+#endif //__MAPPED_FILE_H_
@@ -0,0 +1,555 @@
+#ifndef __PARSE_CONTEXT_H_
+#define __PARSE_CONTEXT_H_
+
+#include <stdio.h>
+#include <ctype.h>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include <memory>
+#include "arena.h"
+#include "flex_util.h"
+#include "json_classes.h"
+#include "json_writer.h"
+#include "json_handler.h"
+#include "twitter_date.h"
+#include "run_stats.h"
+#include "dead_letters.h"
+#include "projection.h"
+#include "columnar.h"
+#include "tape.h"
+#include "hashtag_stats.h"
+
+struct CompressedInput;
+
+// Per run settings, every ParseContext of the run gets a copy.
+struct ParseSettings {
+    // Upper bound for MaxDepth so the bison stack (YYMAXDEPTH) can always hold it.
+    static constexpr int MaxAllowedDepth = 100000;
+
+    // How many objects/arrays can be nested in each other. This is independent of how wide they are.
+    int MaxDepth = 512;
+
+    // Print records without any whitespace, one per line.
+    bool Compact = false;
+
+    // Only validate the records, nothing is printed but the verdicts. 
+    // Objects keep just their special members and generic strings are not decoded.
+    bool ValidateOnly = false;
+
+    // Benchmark stages (see bench.cpp): records are accepted without the outer object checks
+    // and/or not printed, so the time of those can be told apart from the parse itself.
+    bool SkipChecks = false;
+    bool SkipPrint = false;
+
+    // Records are built on a tape (see tape.h) instead of a tree of nodes, they are printed and checked from it.
+    bool UseTape = false;
+
+    // Integers that don't fit in 64 bits are kept as their digits (JValueType::BigInt) instead of read as doubles.
+    bool KeepBigInts = false;
+
+    // Where the hashtags of accepted records are counted, shared by the whole run. Optional.
+    HashtagStats* Hashtags = nullptr;
+
+    // Counters and timers of the run (--stats), every parse attaches its own. Optional.
+    RunStats* Stats = nullptr;
+
+    // Where rejected records are written, shared by the whole run. Optional.
+    DeadLetterQueue* DeadLetters = nullptr;
+
+    // Write these paths of the accepted records as rows instead of the records and their verdicts. Optional.
+    // The whole records are never built so this doesn't go with ValidateOnly, which drops the generic members.
+    const Projection* Project = nullptr;
+
+    // Where the accepted records go as columns instead of being printed, shared by the whole run. Optional.
+    ColumnarFile* Columnar = nullptr;
+
+    // The tree keeps nothing but the special members, generic ones are null.
+    bool SpecialMembersOnly() const {
+        return ValidateOnly;
+    }
+
+    // The records and their verdicts are printed (not rows or columns of them).
+    bool PrintsRecords() const {
+        return !Project && !Columnar;
+    }
+};
+
+// An id of the record being parsed, see ParseContext::RecordIds.
+struct PendingId {
+    // A user id, otherwise an id_str.
+    bool User;
+    std::string_view IdStr;
+    long long UserId;
+    // created_at of the record, only used by a windowed database.
+    long long Time;
+};
+
+// An id that a record of a parse with KeepIds looked up, and whether it was found (the record was rejected then).
+struct IdLookup {
+    PendingId Id;
+    bool Found;
+};
+
+// A record of a parse with KeepIds, and where its part of each output of the parse ends (sizes and positions),
+// so that the parallel ingestion can replace it with the output of another parse of it.
+struct KeptRecord {
+    // Where the record begins in Source, and its line counted from the start of the parse.
+    size_t Begin;
+    int Line;
+    bool Accepted;
+    RejectReason Reason;
+
+    size_t Out;
+    size_t Err;
+    size_t RecordMarks;
+    size_t LineMarks;
+    size_t DeadLetters;
+    size_t Columns;
+    size_t Hashtags;
+    size_t Ids;
+    size_t Lookups;
+};
+
+// Everything a single parse needs. The lexer reaches it through yyextra and the grammar through %parse-param
+// so there is no global state and any number of parses can run concurrently, one context per parse.
+struct ParseContext {
+    ParserState Parse;
+    ParseSettings Settings;
+
+    // Objects/arrays currently open.
+    int Depth = 0;
+    // The rest of a rejected record is being dropped (see SkipRecord), its nesting is neither limited nor reported.
+    bool Skipping = false;
+    // The token that rejected a record while the parser wasn't given it (see SkipValue), 0 if none.
+    int FailedToken = 0;
+
+    // Owns every node and string of the record being parsed. Reset after each record.
+    Arena Nodes;
+
+    // Input that stays valid for the whole parse (mapped file or caller owned buffer).
+    // String tokens point straight into it. Null when reading a stream, then token text is copied in the arena.
+    const char* Source = nullptr;
+    size_t SourceLength = 0;
+    // How much of Source was handed to the scanner so far.
+    size_t SourceRead = 0;
+    // Where the parse started in Source, see ParseRange.
+    size_t SourceBegin = 0;
+    // Stream input read through a decompression thread (see ParseCompressed), null otherwise.
+    CompressedInput* Compressed = nullptr;
+
+    // Input offset right after the last matched token.
+    size_t Offset = 0;
+
+    // Where ids are deduplicated. Multiple contexts may point to the same database, JsonDB is thread safe.
+    JsonDB* Database;
+
+    // Where records and their verdicts are printed.
+    JsonWriter Writer;
+
+    // Receives the parse events, optional.
+    JsonHandler* Handler = nullptr;
+
+    // Builds the tape of the record from the same events, only with Settings.UseTape.
+    std::unique_ptr<TapeBuilder> Tape;
+
+    // Record counters for streaming multiple top level values through a single parse.
+    unsigned long long RecordCount = 0;
+    unsigned long long AcceptedCount = 0;
+
+    // This parse's counters in Settings.Stats, null without stats.
+    ParseStats* Stats = nullptr;
+
+    // Where the current record begins and on which line. Set by the first token of the record (see StartRecord).
+    size_t RecordStart = 0;
+    int RecordLine = 0;
+    bool AtRecordStart = true;
+
+    // Ids of the current record. They only go in Database once the record is accepted (see CommitIds), so
+    // a rejected record never makes a later (eg: corrected) copy of itself a duplicate.
+    // id_strs point into Source or the arena, both outlive the record.
+    std::vector<PendingId> RecordIds;
+
+    // Keep the ids of the accepted records in KeptIds instead of adding them to Database, not with a windowed
+    // database. The parallel ingestion adds them later, in input order: Database then only has the ids of the
+    // chunks before this one (some of them) and KeptDatabase those of this parse.
+    // The id_strs point into Source, which must be set.
+    bool KeepIds = false;
+    std::vector<PendingId> KeptIds;
+    std::unique_ptr<JsonDB> KeptDatabase;
+    // Also with KeepIds, every record and the ids it looked up in Database and KeptDatabase, in input order.
+    std::vector<KeptRecord> KeptRecords;
+    std::vector<IdLookup> Lookups;
+
+    // Stop after the first record.
+    bool SingleRecord = false;
+
+    // The last Reject of the current record.
+    RejectReason LastReason = RejectReason::SyntaxError;
+    std::string LastMessage;
+
+    // Keep the dead letters of this parse here instead of writing them to Settings.DeadLetters.
+    // The parallel ingestion writes them out later, in input order.
+    bool KeepDeadLetters = false;
+    std::vector<DeadLetter> DeadLetters;
+
+    // Position in the paths of Settings.Project, unused without it.
+    ProjectionCursor Projected;
+
+    // Accepted records not yet in Settings.Columnar.
+    // With KeepColumns they all stay here, the parallel ingestion adds them to the file later, in input order.
+    ColumnBatch Columns;
+    bool KeepColumns = false;
+
+    // Keep the hashtags of the accepted records here instead of counting them in Settings.Hashtags.
+    // The parallel ingestion counts them later, in input order.
+    bool KeepHashtags = false;
+    std::vector<HashtagStats::Record> Hashtags;
+
+    // Leave the record numbers of the verdicts out of Writer and mark them here instead (positions in Writer),
+    // and the line numbers of the errors in LineMarks (see ParserState::LineMarks).
+    // The parallel ingestion writes them in later, shifted by the records and lines of the chunks before.
+    bool MarkNumbers = false;
+    std::vector<NumberMark> RecordMarks;
+    std::vector<NumberMark> LineMarks;
+
+    // Without an 'out' file the output is kept in Writer for the caller to collect.
+    ParseContext(JsonDB* database, const ParseSettings& settings = ParseSettings(), FILE* out = stdout)
+        : Settings(settings)
+        , Database(database)
+        , Writer(out, !settings.Compact)
+        , Tape(settings.UseTape ? new TapeBuilder() : nullptr)
+        , Stats(settings.Stats ? settings.Stats->Attach() : nullptr) {}
+
+    ~ParseContext() {
+        if (Stats) {
+            Settings.Stats->Detach(Stats);
+        }
+    }
+
+    ParseContext(const ParseContext&) = delete;
+    ParseContext& operator=(const ParseContext&) = delete;
+
+    // Reports why the current record is rejected.
+    void Reject(RejectReason reason, const std::string& message) {
+        Parse.ReportError(message);
+        LastReason = reason;
+        if (Settings.DeadLetters) {
+            LastMessage = message;
+        }
+        if (Stats) {
+            Stats->Rejected[(int)reason].Add();
+        }
+    }
+
+    // The last matched token is the first one of a record.
+    void StartRecord() {
+        RecordStart = Parse.LastMatchOffset;
+        RecordLine = Parse.LineNum;
+        AtRecordStart = false;
+    }
+
+    // The current record is done (accepted or not), it ends at 'end'.
+    // With 'lookahead' the parser already read the first token of the next record.
+    void EndRecord(bool accepted, size_t end, bool lookahead) {
+        RecordIds.clear();
+        if (Stats) {
+            Stats->EndRecord(accepted, end - SourceBegin, Nodes.Allocations, Nodes.Mallocs);
+        }
+        if (!accepted && Settings.DeadLetters) {
+            DeadLetter letter { RecordStart, RecordLine, LastReason, LastMessage, std::string_view() };
+            if (Source) {
+                while (end > RecordStart && isspace((unsigned char)Source[end - 1])) {
+                    --end;
+                }
+                letter.Record = std::string_view(Source + RecordStart, end - RecordStart);
+            }
+            if (KeepDeadLetters) {
+                DeadLetters.push_back(std::move(letter));
+            }
+            else {
+                Settings.DeadLetters->Write(letter);
+            }
+        }
+        if (KeepIds) {
+            KeptRecords.push_back(KeptRecord { RecordStart, RecordLine, accepted, LastReason, Writer.Buffered(),
+                                               (size_t)Parse.Err->tellp(), RecordMarks.size(), LineMarks.size(),
+                                               DeadLetters.size(), Columns.Rows(), Hashtags.size(), KeptIds.size(),
+                                               Lookups.size() });
+        }
+        if (lookahead) {
+            StartRecord();
+        }
+        else {
+            AtRecordStart = true;
+        }
+    }
+
+    // Checks a top level object: FormsValidOuterObject and the windowed ids. 'tweet' is null with a Tape,
+    // the record is on the tape then.
+    // Returns false with the reason in 'error' and 'reason' if the record must be rejected.
+    bool CheckRecord(const JObject* tweet, std::string& error, RejectReason& reason) {
+        StatScope timer(Stats, StatTimer::Checks);
+        if (Tape ? !Tape->Root().AsObject().FormsValidOuterObject(error) : !tweet->FormsValidOuterObject(error)) {
+            reason = RejectReason::InvalidOuterObject;
+            return false;
+        }
+        if (Database->Windowed() && !CheckWindowedIds(tweet, error)) {
+            reason = RejectReason::WindowedIds;
+            return false;
+        }
+        if (!CommitIds()) {
+            reason = Database->Windowed() ? RejectReason::WindowedIds : RejectReason::DuplicateIdStr;
+            error = "An id of the record was added by another parse first.";
+            return false;
+        }
+        return true;
+    }
+
+    // Adds an id_str of the current record to RecordIds. Returns false if it is a duplicate,
+    // of an earlier record or of another id_str of this one.
+    bool StageIdStr(std::string_view idStr) {
+        const bool found = Database->ContainsIdStr(idStr) || (KeptDatabase && KeptDatabase->ContainsIdStr(idStr));
+        if (KeepIds) {
+            Lookups.push_back(IdLookup { PendingId { false, idStr, 0, 0 }, found });
+        }
+        if (found) {
+            return false;
+        }
+        for (const PendingId& id : RecordIds) {
+            if (!id.User && id.IdStr == idStr) {
+                return false;
+            }
+        }
+        RecordIds.push_back(PendingId { false, idStr, 0, 0 });
+        return true;
+    }
+
+    // Same as StageIdStr for a user id.
+    bool StageUserId(long long userId) {
+        const bool found = Database->ContainsUserId(userId) || (KeptDatabase && KeptDatabase->ContainsUserId(userId));
+        if (KeepIds) {
+            Lookups.push_back(IdLookup { PendingId { true, std::string_view(), userId, 0 }, found });
+        }
+        if (found) {
+            return false;
+        }
+        for (const PendingId& id : RecordIds) {
+            if (id.User && id.UserId == userId) {
+                return false;
+            }
+        }
+        RecordIds.push_back(PendingId { true, std::string_view(), userId, 0 });
+        return true;
+    }
+
+    // The current record is accepted: adds its ids to Database (or KeptIds). Returns false if another parse
+    // sharing Database added one of them since it was staged, the ids before that one stay added.
+    bool CommitIds() {
+        if (KeepIds) {
+            if (!KeptDatabase) {
+                KeptDatabase.reset(new JsonDB());
+            }
+            for (const PendingId& id : RecordIds) {
+                if (id.User) {
+                    KeptDatabase->MaybeInsertUserId(id.UserId);
+                }
+                else {
+                    KeptDatabase->MaybeInsertIdStr(id.IdStr);
+                }
+            }
+            KeptIds.insert(KeptIds.end(), RecordIds.begin(), RecordIds.end());
+            RecordIds.clear();
+            return true;
+        }
+        bool added = true;
+        for (const PendingId& id : RecordIds) {
+            if (Database->Windowed()) {
+                added = (id.User ? Database->MaybeInsertUserId(id.UserId, id.Time)
+                                 : Database->MaybeInsertIdStr(id.IdStr, id.Time)) && added;
+            }
+            else {
+                added = (id.User ? Database->MaybeInsertUserId(id.UserId) : Database->MaybeInsertIdStr(id.IdStr))
+                        && added;
+            }
+        }
+        if (!RecordIds.empty()) {
+            Database->FlushJournal();
+        }
+        RecordIds.clear();
+        return added;
+    }
+
+    // Adds an accepted record to Settings.Columnar, a row group at a time.
+    void AddColumns(const JObject& tweet) {
+        Columns.Add(tweet);
+        if (!KeepColumns && Columns.Rows() >= Settings.Columnar->RowGroupRows) {
+            Settings.Columnar->Add(Columns);
+        }
+    }
+
+    // Counts the hashtags of an accepted record in Settings.Hashtags, 'tweet' is null with a Tape.
+    void AddHashtags(const JObject* tweet) {
+        if (Tape) {
+            AddHashtagsOf(Tape->Root().AsObject());
+        }
+        else {
+            AddHashtagsOf(*tweet);
+        }
+    }
+
+    template <typename Tweet>
+    void AddHashtagsOf(const Tweet& tweet) {
+        if (KeepHashtags) {
+            Hashtags.push_back(Settings.Hashtags->Collect(tweet));
+        }
+        else {
+            Settings.Hashtags->AddRecord(tweet);
+        }
+    }
+
+    // Prints the verdict line of the current record, if records are printed at all.
+    void Verdict(const char* text) {
+        if (!Settings.PrintsRecords()) {
+            return;
+        }
+        Writer.Write("Record ");
+        if (MarkNumbers) {
+            RecordMarks.push_back(NumberMark { Writer.Buffered(), (long long)RecordCount });
+        }
+        else {
+            Writer.WriteInt(RecordCount);
+        }
+        Writer.Write(": ");
+        Writer.Write(text);
+        Writer.Put('\n');
+    }
+
+    // Allocates a node of the current record.
+    template <typename T, typename... Args>
+    T* New(Args&&... args) {
+        return new (Nodes) T(std::forward<Args>(args)...);
+    }
+
+    // Decodes a string token into a new JString value.
+    JValue* NewString(TextRef text) {
+        return New<JValue>(New<JString>(Nodes, text));
+    }
+
+    // String value of a generic member or array element.
+    // Validation never looks into those so they are not even decoded when only special members are kept.
+    JValue* GenericString(TextRef text) {
+        if (Settings.SpecialMembersOnly()) {
+            JValue* value = New<JValue>();
+            value->Type = JValueType::String;
+            value->Data.StringData = nullptr;
+            return value;
+        }
+        return NewString(text);
+    }
+
+    // Windowed dedup (see JsonDB::UseWindow) of a valid outer object: its id_str and user id are checked
+    // within the window of its created_at and staged for CommitIds. Returns false with the reason in 'error'
+    // for duplicates. 'tweet' is null with a Tape.
+    bool CheckWindowedIds(const JObject* tweet, std::string& error) {
+        std::string_view createdAt, idStr;
+        bool hasUserId;
+        long long userId = 0;
+        if (Tape) {
+            const TapeSpecialMembers members(Tape->Root().AsObject());
+            const TapeValue id = TapeSpecialMembers(members.User.AsObject()).UId;
+            createdAt = members.CreatedAt.AsString();
+            idStr = members.IdStr.AsString();
+            hasUserId = (bool)id;
+            userId = hasUserId ? id.AsInt() : 0;
+        }
+        else {
+            createdAt = tweet->Members.CreatedAt->Text;
+            idStr = tweet->Members.IdStr->Text;
+            hasUserId = tweet->Members.User->Members.UId;
+            userId = hasUserId ? *tweet->Members.User->Members.UId : 0;
+        }
+
+        long long time;
+        if (!ParseCreatedAt(createdAt, time)) {
+            error = "Invalid created_at date.";
+            return false;
+        }
+        if (Database->ContainsIdStr(idStr, time)) {
+            error = "ID String already exists.";
+            return false;
+        }
+        if (hasUserId && Database->ContainsUserId(userId, time)) {
+            error = "User ID already exists.";
+            return false;
+        }
+        RecordIds.push_back(PendingId { false, idStr, 0, time });
+        if (hasUserId) {
+            RecordIds.push_back(PendingId { true, std::string_view(), userId, time });
+        }
+        return true;
+    }
+
+    // Scans Source from 'begin' on (see ParseRange): offsets and the lines shown in errors stay those of Source.
+    void StartAt(const char* data, size_t begin, size_t end) {
+        Source = data;
+        Parse.Source = data;
+        SourceLength = end;
+        SourceRead = begin;
+        SourceBegin = begin;
+        Offset = begin;
+        // The line of 'begin' may start before it, the previous line is the one that ends there.
+        const char* line = data + begin;
+        while (line > data && line[-1] != '\n') {
+            --line;
+        }
+        Parse.LineStart = line - data;
+        Parse.PrevLineStart = Parse.LineStart;
+        if (line > data) {
+            const char* previous = line - 1;
+            while (previous > data && previous[-1] != '\n') {
+                --previous;
+            }
+            Parse.PrevLineStart = previous - data;
+        }
+        if (MarkNumbers) {
+            Parse.LineMarks = &LineMarks;
+        }
+    }
+
+    // Returns the text of the (unquoted) token just matched. 'text' is the scanner's copy of the token.
+    TextRef TokenText(const char* text, size_t length) {
+        if (Source) {
+            return TextRef { Source + Offset - length, length };
+        }
+        return TextRef { Nodes.CopyString(text, length), length };
+    }
+
+    // Returns the contents of the quoted token just matched. 'text' is the scanner's copy of the token.
+    TextRef QuotedText(const char* text, size_t length) {
+        if (Source) {
+            return TextRef { Source + Offset - length + 1, length - 2 };
+        }
+        return TextRef { Nodes.CopyString(text + 1, length - 2), length - 2 };
+    }
+};
+
+// Parses every record of 'in' using a scanner owned by this call. Defined in the lexer.
+// Returns the yyparse() result.
+int ParseFile(ParseContext& ctx, FILE* in);
+
+// Same as ParseFile for compressed input (or a stream that MayBeCompressed), decompressed on the thread of 'in'.
+int ParseCompressed(ParseContext& ctx, CompressedInput& in);
+
+// Same as ParseFile but scans an in memory buffer of 'length' bytes in place.
+// The buffer must stay valid as long as the parsed values are used.
+int ParseBuffer(ParseContext& ctx, const char* data, size_t length);
+
+// Same as ParseBuffer but only scans the bytes [begin, end) of the buffer. Line numbers count from the line of
+// 'begin', offsets (eg: of dead letters) and the lines shown in errors still refer to the whole buffer.
+int ParseRange(ParseContext& ctx, const char* data, size_t begin, size_t end);
+
+// Only runs the scanner of ParseBuffer over the buffer, the tokens are dropped. Returns how many there were.
+size_t LexBuffer(ParseContext& ctx, const char* data, size_t length);
+
+#endif //__PARSE_CONTEXT_H_
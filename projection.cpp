@@ -0,0 +1,149 @@
+#include "projection.h"
+
+bool Projection::Add(std::string_view paths) {
+    while (true) {
+        const size_t comma = paths.find(',');
+        const std::string_view path = paths.substr(0, comma);
+
+        std::vector<std::string> names;
+        Node* node = &Root;
+        size_t begin = 0;
+        while (true) {
+            const size_t dot = path.find('.', begin);
+            const std::string_view name = path.substr(begin, dot == std::string_view::npos ? dot : dot - begin);
+            if (name.empty()) {
+                return false;
+            }
+            names.emplace_back(name);
+
+            Node* child = nullptr;
+            for (auto& existing : node->Children) {
+                if (existing->Key == name) {
+                    child = existing.get();
+                }
+            }
+            if (!child) {
+                node->Children.emplace_back(new Node());
+                child = node->Children.back().get();
+                child->Key = std::string(name);
+            }
+            node = child;
+
+            if (dot == std::string_view::npos) {
+                break;
+            }
+            begin = dot + 1;
+        }
+        node->Whole = true;
+        Columns.push_back(std::move(names));
+
+        if (comma == std::string_view::npos) {
+            return true;
+        }
+        paths.remove_prefix(comma + 1);
+    }
+}
+
+const Projection::Node* Projection::Child(const Node* parent, std::string_view key) {
+    if (!parent || parent->Whole) {
+        return parent;
+    }
+    for (const auto& child : parent->Children) {
+        if (child->Key == key) {
+            return child.get();
+        }
+    }
+    return nullptr;
+}
+
+void Projection::WriteHeader(JsonWriter& out) const {
+    for (size_t i = 0; i < Columns.size(); ++i) {
+        if (i) {
+            out.Put(Delimited == Format::Csv ? ',' : '\t');
+        }
+        std::string path;
+        for (const std::string& name : Columns[i]) {
+            path += path.empty() ? name : "." + name;
+        }
+        WriteField(path, out);
+    }
+    out.EndRecord();
+}
+
+// The member 'name' of 'value' if it is an object. Member names are compared as they are in the input (undecoded).
+// A repeated name gives its last member, like the special member slots keep the last one.
+static const JValue* FindMember(const JValue* value, std::string_view name) {
+    if (!value || value->Type != JValueType::Object) {
+        return nullptr;
+    }
+    const ArenaVector<JMember*>& members = value->Data.ObjectData->Memberlist;
+    for (auto member = members.rbegin(); member != members.rend(); ++member) {
+        if ((*member)->Name == name) {
+            return (*member)->Value;
+        }
+    }
+    return nullptr;
+}
+
+void Projection::WriteRow(const JObject& record, JsonWriter& out) const {
+    // Values other than strings are formatted here first, then written as a field.
+    static thread_local JsonWriter json(nullptr, false);
+
+    const JValue root(const_cast<JObject*>(&record));
+    for (size_t i = 0; i < Columns.size(); ++i) {
+        if (i) {
+            out.Put(Delimited == Format::Csv ? ',' : '\t');
+        }
+        const JValue* value = &root;
+        for (const std::string& name : Columns[i]) {
+            value = FindMember(value, name);
+        }
+        if (!value || value->Type == JValueType::NullVal) {
+            continue;
+        }
+        if (value->Type == JValueType::String) {
+            WriteField(value->Data.StringData->Text, out);
+        }
+        else {
+            value->Print(json, 0);
+            WriteField(json.Take(), out);
+        }
+    }
+    out.EndRecord();
+}
+
+void Projection::WriteField(std::string_view text, JsonWriter& out) const {
+    if (Delimited == Format::Tsv) {
+        size_t plain = 0;
+        for (size_t i = 0; i < text.size(); ++i) {
+            char escaped;
+            switch (text[i]) {
+                case '\t': escaped = 't'; break;
+                case '\n': escaped = 'n'; break;
+                case '\r': escaped = 'r'; break;
+                case '\\': escaped = '\\'; break;
+                default: continue;
+            }
+            out.Write(text.substr(plain, i - plain));
+            out.Put('\\');
+            out.Put(escaped);
+            plain = i + 1;
+        }
+        out.Write(text.substr(plain));
+        return;
+    }
+
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+        out.Write(text);
+        return;
+    }
+    out.Put('"');
+    size_t plain = 0;
+    for (size_t quote = text.find('"'); quote != std::string_view::npos; quote = text.find('"', quote + 1)) {
+        out.Write(text.substr(plain, quote + 1 - plain));
+        out.Put('"');
+        plain = quote + 1;
+    }
+    out.Write(text.substr(plain));
+    out.Put('"');
+}
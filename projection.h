@@ -0,0 +1,86 @@
+#ifndef __PROJECTION_H_
+#define __PROJECTION_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+#include "json_classes.h"
+#include "json_writer.h"
+
+// Field projection (--project): instead of the whole records, the values of a few member paths of every accepted
+// record are written as one delimited row (TSV or CSV, with a header row of the paths).
+// A path is member names joined by '.' (eg: user.screen_name), arrays are not indexed.
+// Strings are written decoded, objects and arrays as compact JSON, null and missing members as empty fields.
+//
+// Values that no path goes through are skipped by the lexer without building any nodes (see ProjectToken in the grammar).
+// Only members with a STRING name are skipped, the special members (F_* keys) are always parsed since the checks
+// of the record need them.
+struct Projection {
+    enum class Format {
+        // Tabs, line breaks and backslashes in a field are escaped as \t, \n, \r and \\.
+        Tsv,
+        // RFC 4180: fields with commas, quotes or line breaks are quoted.
+        Csv
+    };
+
+    // A member name of the paths, the paths form a tree from the record down.
+    struct Node {
+        std::string Key;
+        // A path ends here, everything below is kept.
+        bool Whole = false;
+        std::vector<std::unique_ptr<Node>> Children;
+    };
+
+    Format Delimited = Format::Tsv;
+    // Member names of each path, one column each.
+    std::vector<std::vector<std::string>> Columns;
+    Node Root;
+
+    // Adds the comma separated 'paths'. Returns false if any of them is empty or has an empty member name.
+    bool Add(std::string_view paths);
+
+    // Node of the member 'key' of an object at 'parent', null if the member is not wanted (or 'parent' isn't).
+    static const Node* Child(const Node* parent, std::string_view key);
+
+    void WriteHeader(JsonWriter& out) const;
+    void WriteRow(const JObject& record, JsonWriter& out) const;
+
+private:
+    void WriteField(std::string_view text, JsonWriter& out) const;
+};
+
+// Where a parse is in the paths of its Projection. Kept up to date by the grammar as the tokens go by.
+struct ProjectionCursor {
+    struct Frame {
+        const Projection::Node* Node;
+        bool Array;
+    };
+
+    // Objects/arrays currently open in the record.
+    std::vector<Frame> Frames;
+    // Node of the value of the current member, set by its ':'.
+    const Projection::Node* Member = nullptr;
+    // The last token that can be a member name: STRING (generic) or one of the F_* keys.
+    TextRef Key {};
+    bool GenericKey = false;
+    // The value after the current ':' is skipped.
+    bool SkipValue = false;
+
+    // Node of the value that begins with the next token.
+    const Projection::Node* ValueNode(const Projection& paths) const {
+        if (Frames.empty()) {
+            return &paths.Root;
+        }
+        return Frames.back().Array ? Frames.back().Node : Member;
+    }
+
+    void Reset() {
+        Frames.clear();
+        Member = nullptr;
+        SkipValue = false;
+    }
+};
+
+#endif //__PROJECTION_H_
@@ -0,0 +1,191 @@
+#include "run_stats.h"
+#include "json_writer.h"
+
+#include <algorithm>
+
+static std::atomic<bool> DumpRequested{false};
+
+// How often the reporter looks for requested dumps.
+static const std::chrono::milliseconds PollInterval(100);
+
+#define REJECT_KEY(Name, Key) Key,
+static const char* const RejectKeys[] = { REJECT_REASONS(REJECT_KEY) };
+#undef REJECT_KEY
+
+const char* RejectReasonKey(RejectReason reason) {
+    return RejectKeys[(int)reason];
+}
+
+void ParseStats::Add(const ParseStats& other) {
+    for (int i = 0; i < TokenKinds; ++i) {
+        Tokens[i].Add(other.Tokens[i].Get());
+    }
+    for (int i = 0; i < (int)RejectReason::Count; ++i) {
+        Rejected[i].Add(other.Rejected[i].Get());
+    }
+    for (int i = 0; i < (int)StatTimer::Count; ++i) {
+        Nanos[i].Add(other.Nanos[i].Get());
+        Timed[i].Add(other.Timed[i].Get());
+    }
+    Records.Add(other.Records.Get());
+    Accepted.Add(other.Accepted.Get());
+    Bytes.Add(other.Bytes.Get());
+    Allocations.Add(other.Allocations.Get());
+    Mallocs.Add(other.Mallocs.Get());
+    BusyNanos.Add(other.BusyNanos.Get());
+}
+
+uint64_t ParseStats::ClockOverhead() {
+    // The median of back to back clock reads, outliers (preemption) don't move it.
+    static const uint64_t overhead = []() {
+        uint64_t reads[255];
+        for (uint64_t& read : reads) {
+            const uint64_t start = Now();
+            read = Now() - start;
+        }
+        std::nth_element(reads, reads + 127, reads + 255);
+        return reads[127];
+    }();
+    return overhead;
+}
+
+uint64_t ParseStats::TimedNanos(StatTimer timer) const {
+    const uint64_t nanos = Nanos[(int)timer].Get();
+    const uint64_t overhead = Timed[(int)timer].Get() * ClockOverhead();
+    return nanos > overhead ? nanos - overhead : 0;
+}
+
+// Bison quotes the names of literal tokens ('}', "end of file"), the keys go without the quotes.
+static std::string_view TokenKey(const char* name) {
+    std::string_view key(name);
+    if (key.length() >= 2 && (key[0] == '\'' || key[0] == '"') && key.back() == key[0]) {
+        key = key.substr(1, key.length() - 2);
+    }
+    return key;
+}
+
+RunStats::RunStats(FILE* out, long long everySeconds)
+    : Out(out)
+    , Reporter([this, everySeconds]() { Report(everySeconds); }) {}
+
+RunStats::~RunStats() {
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        Stop = true;
+    }
+    Stopping.notify_all();
+    Reporter.join();
+}
+
+ParseStats* RunStats::Attach() {
+    std::lock_guard<std::mutex> guard(Lock);
+    Active.emplace_back(new ParseStats());
+    return Active.back().get();
+}
+
+void RunStats::Detach(ParseStats* parse) {
+    std::lock_guard<std::mutex> guard(Lock);
+    Finished.Add(*parse);
+    auto found = std::find_if(Active.begin(), Active.end(), [parse](auto& active) { return active.get() == parse; });
+    Active.erase(found);
+}
+
+void RunStats::RequestDump() {
+    DumpRequested.store(true, std::memory_order_relaxed);
+}
+
+void RunStats::Report(long long everySeconds) {
+    const auto every = std::chrono::seconds(everySeconds);
+    auto next = std::chrono::steady_clock::now() + every;
+
+    std::unique_lock<std::mutex> guard(Lock);
+    while (!Stopping.wait_for(guard, PollInterval, [this]() { return Stop; })) {
+        const bool due = everySeconds > 0 && std::chrono::steady_clock::now() >= next;
+        if (due || DumpRequested.exchange(false)) {
+            guard.unlock();
+            Dump();
+            guard.lock();
+            if (due) {
+                next += every;
+            }
+        }
+    }
+}
+
+void RunStats::Dump() {
+    ParseStats total;
+    {
+        std::lock_guard<std::mutex> guard(Lock);
+        total.Add(Finished);
+        for (const auto& active : Active) {
+            total.Add(*active);
+        }
+    }
+
+    const double seconds = (ParseStats::Now() - Start) / 1e9;
+    const uint64_t records = total.Records.Get();
+    const uint64_t lexerNanos = total.TimedNanos(StatTimer::Lexer) * ParseStats::LexerSample;
+    const uint64_t checksNanos = total.TimedNanos(StatTimer::Checks);
+    const uint64_t printNanos = total.TimedNanos(StatTimer::Print);
+    const uint64_t timed = lexerNanos + checksNanos + printNanos;
+    const uint64_t busy = total.BusyNanos.Get();
+
+    JsonWriter out(Out, false);
+    out.Write("{\"stats\":{\"seconds\":");
+    out.WriteFloat(seconds);
+    out.Write(",\"bytes\":");
+    out.WriteInt(total.Bytes.Get());
+    out.Write(",\"mb_per_second\":");
+    out.WriteFloat(seconds > 0 ? total.Bytes.Get() / seconds / 1e6 : 0);
+    out.Write(",\"records\":");
+    out.WriteInt(records);
+    out.Write(",\"records_per_second\":");
+    out.WriteFloat(seconds > 0 ? records / seconds : 0);
+    out.Write(",\"accepted\":");
+    out.WriteInt(total.Accepted.Get());
+
+    out.Write(",\"rejected\":{");
+    bool first = true;
+    for (int i = 0; i < (int)RejectReason::Count; ++i) {
+        if (total.Rejected[i].Get()) {
+            out.Write(first ? "\"" : ",\"");
+            out.Write(RejectKeys[i]);
+            out.Write("\":");
+            out.WriteInt(total.Rejected[i].Get());
+            first = false;
+        }
+    }
+
+    out.Write("},\"tokens\":{");
+    first = true;
+    for (int i = 0; i < ParseStats::TokenKinds; ++i) {
+        if (total.Tokens[i].Get()) {
+            if (!first) {
+                out.Put(',');
+            }
+            out.WriteString(TokenKey(TokenKindName(i)));
+            out.Put(':');
+            out.WriteInt(total.Tokens[i].Get());
+            first = false;
+        }
+    }
+
+    out.Write("},\"allocations_per_record\":");
+    out.WriteFloat(records ? (double)total.Allocations.Get() / records : 0);
+    out.Write(",\"arena_mallocs\":");
+    out.WriteInt(total.Mallocs.Get());
+
+    // Seconds of all the parses together, more than the run itself when they are parallel.
+    out.Write(",\"parse_seconds\":{\"lexer\":");
+    out.WriteFloat(lexerNanos / 1e9);
+    out.Write(",\"grammar\":");
+    out.WriteFloat(busy > timed ? (busy - timed) / 1e9 : 0);
+    out.Write(",\"checks\":");
+    out.WriteFloat(checksNanos / 1e9);
+    out.Write(",\"print\":");
+    out.WriteFloat(printNanos / 1e9);
+    out.Write("}}}");
+    out.EndRecord();
+    out.Flush();
+    fflush(Out);
+}
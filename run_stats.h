@@ -0,0 +1,193 @@
+#ifndef __RUN_STATS_H_
+#define __RUN_STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+// Why a record was rejected.
+//   Name:  RejectReason enumerator.
+//   Key:   name in the stats output.
+#define REJECT_REASONS(X) \
+    X(NotAnObject,          "not_an_object") \
+    X(InvalidOuterObject,   "invalid_outer_object") \
+    X(WindowedIds,          "windowed_ids") \
+    X(DuplicateIdStr,       "duplicate_id_str") \
+    X(DuplicateUserId,      "duplicate_user_id") \
+    X(InvalidUtf8,          "invalid_utf8") \
+    X(TextTooLong,          "text_too_long") \
+    X(InvalidUser,          "invalid_user") \
+    X(InvalidRetweet,       "invalid_retweet") \
+    X(InvalidExtendedTweet, "invalid_extended_tweet") \
+    X(InvalidEntities,      "invalid_entities") \
+    X(InvalidRange,         "invalid_range") \
+    X(TooDeep,              "too_deep") \
+    X(SyntaxError,          "syntax_error")
+
+#define REJECT_ENUMERATOR(Name, Key) Name,
+enum class RejectReason {
+    REJECT_REASONS(REJECT_ENUMERATOR)
+    Count
+};
+#undef REJECT_ENUMERATOR
+
+// Name of a reason in the stats and dead letters.
+const char* RejectReasonKey(RejectReason reason);
+
+// Bison's name of a token kind (symbol number). Defined in the grammar.
+const char* TokenKindName(int kind);
+
+// Written by a single thread (the one doing the parse), read by any.
+// A relaxed load and store instead of a read-modify-write, so counting costs about the same as a plain add.
+struct StatCounter {
+    std::atomic<uint64_t> Value{0};
+
+    void Add(uint64_t amount = 1) {
+        Value.store(Value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void Remove(uint64_t amount = 1) {
+        Value.store(Value.load(std::memory_order_relaxed) - amount, std::memory_order_relaxed);
+    }
+
+    void Set(uint64_t value) {
+        Value.store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t Get() const {
+        return Value.load(std::memory_order_relaxed);
+    }
+};
+
+// Timed parts of a parse. Whatever else the parse spends is grammar actions (building the records, I/O).
+enum class StatTimer {
+    Lexer,
+    Checks,
+    Print,
+    Count
+};
+
+// Counters of one parse (ParseContext).
+struct ParseStats {
+    // Enough for every token kind of the grammar (checked there).
+    static const int TokenKinds = 64;
+    // Only one every LexerSample tokens is timed, the lexer time is scaled up from those.
+    static const uint64_t LexerSample = 64;
+
+    StatCounter Tokens[TokenKinds];
+    StatCounter Records;
+    StatCounter Accepted;
+    StatCounter Rejected[(int)RejectReason::Count];
+    // Input up to the end of the last record.
+    StatCounter Bytes;
+    // Arena allocations and the mallocs behind them (Arena::Allocations/Mallocs).
+    StatCounter Allocations;
+    StatCounter Mallocs;
+    StatCounter Nanos[(int)StatTimer::Count];
+    // How many times each timer ran, every run also measured ClockOverhead.
+    StatCounter Timed[(int)StatTimer::Count];
+    // From the start of the parse to the end of the last record.
+    StatCounter BusyNanos;
+
+    // Tokens so far, picks the ones that are timed. Only used by the thread of the parse.
+    uint64_t Lexed = 0;
+
+    const uint64_t Start = Now();
+
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Time(StatTimer timer, uint64_t since) {
+        Nanos[(int)timer].Add(Now() - since);
+        Timed[(int)timer].Add();
+    }
+
+    // What timing a scope adds to its time: about one clock read, calibrated once per process.
+    // A single token takes about as long, so the lexer samples are worthless without taking it off.
+    static uint64_t ClockOverhead();
+
+    // Nanoseconds of 'timer' without the ClockOverhead of each run.
+    uint64_t TimedNanos(StatTimer timer) const;
+
+    // A record is done, 'offset' is where it ends in the input.
+    void EndRecord(bool accepted, size_t offset, size_t allocations, size_t mallocs) {
+        Records.Add();
+        if (accepted) {
+            Accepted.Add();
+        }
+        Bytes.Set(offset);
+        Allocations.Set(allocations);
+        Mallocs.Set(mallocs);
+        BusyNanos.Set(Now() - Start);
+    }
+
+    // Adds every counter of 'other' to this one.
+    void Add(const ParseStats& other);
+};
+
+// Times a scope as 'timer', does nothing without stats.
+struct StatScope {
+    ParseStats* Stats;
+    StatTimer Timer;
+    uint64_t Since;
+
+    StatScope(ParseStats* stats, StatTimer timer)
+        : Stats(stats)
+        , Timer(timer)
+        , Since(stats ? ParseStats::Now() : 0) {}
+
+    ~StatScope() {
+        if (Stats) {
+            Stats->Time(Timer, Since);
+        }
+    }
+};
+
+// Opt-in (--stats) counters and timers of a run, shared by all of its parses.
+// Every parse counts into its own ParseStats so parallel parses never write the same memory,
+// a dump sums the live ones and the ones that finished.
+//
+// Writes a JSON line to 'out' at exit (Dump), every 'everySeconds' if > 0 and when asked with RequestDump.
+// The periodic and requested dumps come from a reporter thread.
+struct RunStats {
+    RunStats(FILE* out, long long everySeconds);
+    ~RunStats();
+
+    RunStats(const RunStats&) = delete;
+    RunStats& operator=(const RunStats&) = delete;
+
+    // Counters for a new parse, they stay owned by the run. Detach them when the parse is done.
+    ParseStats* Attach();
+    void Detach(ParseStats* parse);
+
+    // Writes the stats line now.
+    void Dump();
+
+    // Asks the reporter for a dump. Async signal safe (eg: from a SIGUSR1 handler).
+    static void RequestDump();
+
+private:
+    void Report(long long everySeconds);
+
+    FILE* Out;
+    const uint64_t Start = ParseStats::Now();
+
+    std::mutex Lock;
+    std::vector<std::unique_ptr<ParseStats>> Active;
+    // Sum of the detached parses.
+    ParseStats Finished;
+
+    std::condition_variable Stopping;
+    bool Stop = false;
+    std::thread Reporter;
+};
+
+#endif //__RUN_STATS_H_
@@ -0,0 +1,189 @@
+#ifndef __SCHEMA_H_
+#define __SCHEMA_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <string_view>
+
+// Every tweet field the parser knows about. The JSpecialMember enum, the slots of JSpecialMembers/JExSpecialMembers,
+// the slot dispatch of JObject and the key lookup of the lexers are all generated from these tables.
+//
+// X(Name, Key, Token, Kind)
+//   Name:  JSpecialMember enumerator and slot name.
+//   Key:   member name in the json.
+//   Token: lexer token of the key. Fields with their own grammar rules have an F_* token, the rest are plain
+//          STRING keys captured by the generic member rule.
+//   Kind:  what the slot keeps: String, Int, Bool, Object, Array or Range (see the *Slot functions).
+//          Captured values of another type are ignored.
+//
+// Adding a captured field only needs a line here.
+
+// Fields of tweet and user objects, kept in JSpecialMembers.
+#define TWEET_FIELDS(X) \
+    X(IdStr,                "id_str",                       F_ID_STR,       String) \
+    X(Text,                 "text",                         F_TEXT,         String) \
+    X(CreatedAt,            "created_at",                   F_CREATEDAT,    String) \
+    X(User,                 "user",                         F_USER,         Object) \
+    X(UName,                "name",                         F_UNAME,        String) \
+    X(UScreenName,          "screen_name",                  F_USCREEN,      String) \
+    X(ULocation,            "location",                     F_ULOCATION,    String) \
+    X(UId,                  "id",                           F_UID,          Int) \
+    X(TweetObj,             "tweet",                        F_RT_TWEET,     Object) \
+    X(Lang,                 "lang",                         STRING,         String) \
+    X(Source,               "source",                       STRING,         String) \
+    X(InReplyToStatusIdStr, "in_reply_to_status_id_str",    STRING,         String) \
+    X(InReplyToUserIdStr,   "in_reply_to_user_id_str",      STRING,         String) \
+    X(InReplyToScreenName,  "in_reply_to_screen_name",      STRING,         String) \
+    X(QuotedStatusIdStr,    "quoted_status_id_str",         STRING,         String) \
+    X(QuotedStatus,         "quoted_status",                STRING,         Object) \
+    X(IsQuoteStatus,        "is_quote_status",              STRING,         Bool) \
+    X(QuoteCount,           "quote_count",                  STRING,         Int) \
+    X(ReplyCount,           "reply_count",                  STRING,         Int) \
+    X(RetweetCount,         "retweet_count",                STRING,         Int) \
+    X(FavoriteCount,        "favorite_count",               STRING,         Int) \
+    X(Favorited,            "favorited",                    STRING,         Bool) \
+    X(Retweeted,            "retweeted",                    STRING,         Bool) \
+    X(PossiblySensitive,    "possibly_sensitive",           STRING,         Bool) \
+    X(FilterLevel,          "filter_level",                 STRING,         String) \
+    X(TimestampMs,          "timestamp_ms",                 STRING,         String) \
+    X(Place,                "place",                        STRING,         Object) \
+    X(UDescription,         "description",                  STRING,         String) \
+    X(UVerified,            "verified",                     STRING,         Bool) \
+    X(UFollowersCount,      "followers_count",              STRING,         Int) \
+    X(UFriendsCount,        "friends_count",                STRING,         Int) \
+    X(UStatusesCount,       "statuses_count",               STRING,         Int)
+
+// Fields of extended tweets, kept in JExSpecialMembers.
+#define EXTENDED_TWEET_FIELDS(X) \
+    X(ExTweet,              "extended_tweet",               F_ET_DECLARATION,   Object) \
+    X(Truncated,            "truncated",                    F_ET_TRUNC,         Bool) \
+    X(DisplayRange,         "display_text_range",           F_ET_DISPLAYRANGE,  Range) \
+    X(Entities,             "entities",                     F_ET_ENTITIES,      Object) \
+    X(Hashtags,             "hashtags",                     F_ET_HASHTAGS,      Array) \
+    X(Indices,              "indices",                      F_ET_INDICES,       Range) \
+    X(FullText,             "full_text",                    F_ET_FULLTEXT,      String)
+
+#define SCHEMA_FIELDS(X) TWEET_FIELDS(X) EXTENDED_TWEET_FIELDS(X)
+
+// "retweeted_status" has its own token but no slot, the grammar only uses it to validate the nested tweet.
+#define SCHEMA_KEYWORDS(X) \
+    SCHEMA_FIELDS(X) \
+    X(None,                 "retweeted_status",             F_RT_STATUS,    None)
+
+#define SCHEMA_ENUMERATOR(Name, Key, Token, Kind) Name,
+
+// Special members are all the members we keep a slot for.
+enum class JSpecialMember {
+    None, // Not a special member
+    SCHEMA_FIELDS(SCHEMA_ENUMERATOR)
+};
+
+#undef SCHEMA_ENUMERATOR
+
+// Compile time perfect hash of the schema keys.
+// The seed is searched at compile time so no two keys share a table slot, a lookup is one hash and one compare.
+namespace schema {
+
+struct Key {
+    std::string_view Name;
+    JSpecialMember Type;
+};
+
+#define SCHEMA_KEY(Name, Key, Token, Kind) { Key, JSpecialMember::Name },
+
+// In SCHEMA_KEYWORDS order, the lexers map the index of a key to its token.
+inline constexpr Key Keys[] = {
+    SCHEMA_KEYWORDS(SCHEMA_KEY)
+};
+
+#undef SCHEMA_KEY
+
+constexpr size_t KeyCount = sizeof(Keys) / sizeof(Keys[0]);
+
+constexpr size_t TableSize = 256;
+static_assert(TableSize >= KeyCount * 4 && (TableSize & (TableSize - 1)) == 0, "Grow the key table");
+
+constexpr uint32_t Hash(std::string_view key, uint32_t seed) {
+    uint32_t hash = seed ^ (uint32_t)key.size();
+    for (char c : key) {
+        hash = (hash ^ (unsigned char)c) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+constexpr bool IsPerfect(uint32_t seed) {
+    bool used[TableSize] = {};
+    for (const Key& key : Keys) {
+        const size_t slot = Hash(key.Name, seed) & (TableSize - 1);
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t FindSeed() {
+    uint32_t seed = 2166136261u;
+    while (!IsPerfect(seed)) {
+        ++seed;
+    }
+    return seed;
+}
+
+constexpr uint32_t Seed = FindSeed();
+
+constexpr size_t ShortestKey() {
+    size_t length = Keys[0].Name.size();
+    for (const Key& key : Keys) {
+        length = key.Name.size() < length ? key.Name.size() : length;
+    }
+    return length;
+}
+
+constexpr size_t LongestKey() {
+    size_t length = 0;
+    for (const Key& key : Keys) {
+        length = key.Name.size() > length ? key.Name.size() : length;
+    }
+    return length;
+}
+
+constexpr size_t MinKeyLength = ShortestKey();
+constexpr size_t MaxKeyLength = LongestKey();
+
+// Slot -> index in Keys + 1, 0 for empty slots.
+struct Table {
+    unsigned char Slots[TableSize];
+};
+
+constexpr Table BuildTable() {
+    Table table = {};
+    for (size_t i = 0; i < KeyCount; ++i) {
+        table.Slots[Hash(Keys[i].Name, Seed) & (TableSize - 1)] = (unsigned char)(i + 1);
+    }
+    return table;
+}
+
+inline constexpr Table Lookup = BuildTable();
+
+// The schema entry of a member name, null if it is not a schema key.
+inline const Key* Find(std::string_view name) {
+    if (name.size() < MinKeyLength || name.size() > MaxKeyLength) {
+        return nullptr;
+    }
+    const unsigned char slot = Lookup.Slots[Hash(name, Seed) & (TableSize - 1)];
+    if (slot && Keys[slot - 1].Name == name) {
+        return &Keys[slot - 1];
+    }
+    return nullptr;
+}
+
+inline JSpecialMember FindMember(std::string_view name) {
+    const Key* key = Find(name);
+    return key ? key->Type : JSpecialMember::None;
+}
+
+} // namespace schema
+
+#endif //__SCHEMA_H_
@@ -0,0 +1,486 @@
+// Hand written scanner, an alternative backend to json_parser.l (build with 'make SCANNER=simd').
+//
+// It returns exactly the same tokens and reports the same matches/lines to ParserState as the flex rules do.
+// Instead of stepping a DFA over every byte it finds the end of strings and whitespace runs 16 (SSE2)
+// or 32 (AVX2) bytes at a time, which is where nearly all of the input bytes are.
+//
+// Flex picks the longest match and the first rule on ties, for our rules that boils down to:
+//  * A quoted string is one token, classified by its content as F_* (see schema.h), D_ID_STR, D_DATE or STRING.
+//  * Anything else that is not a delimiter is matched as a whole run which is a number/true/false/null
+//    if the whole run matches that rule, otherwise INVALID_CHARACTER.
+//  * Input that no rule matches (eg: a string with an invalid escape) is echoed byte by byte (flex's default rule).
+#include "parse_context.h"
+#include "compressed_input.h"
+#include "y.tab.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+
+#include "simd_util.h"
+
+namespace {
+
+// Returned by the token scanners when the token may continue past the data read so far.
+const int NeedMore = -100;
+// Returned for matches that don't produce a token (whitespace, newlines, echoed bytes).
+const int NoToken = -101;
+
+const size_t StreamBlockSize = 1 << 20;
+
+// First byte of [p, end) that can end (or invalidate) the content of a string.
+const char* FindStringSpecial(const char* p, const char* end) {
+    return simd::FindAny<'"', '\\', '\n', '\r'>(p, end);
+}
+
+// First byte of [p, end) that is not a {space}.
+const char* SkipSpaces(const char* p, const char* end) {
+    return simd::SkipAny<' ', '\t'>(p, end);
+}
+
+// --- Token classification (mirrors the flex definitions) ---------------------------------------------------
+
+// Characters that end an {errchar} run.
+bool IsDelimiter(char c) {
+    switch (c) {
+        case '"': case '[': case ']': case ',': case ':': case '{': case '}':
+        case '\r': case '\n': case '\t': case ' ':
+            return true;
+    }
+    return false;
+}
+
+bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool IsHex(char c) {
+    return IsDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+bool MatchesAny(const char* text, const char* const* options, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (memcmp(text, options[i], 3) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// {date} without the quotes: "Sun Jan 01 23:59:59 +0000 2018" or without the timezone.
+bool IsDate(const char* s, size_t length) {
+    static const char* const Days[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    static const char* const Months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    if (length != 24 && length != 30) {
+        return false;
+    }
+    if (!MatchesAny(s, Days, 7) || s[3] != ' ' || !MatchesAny(s + 4, Months, 12) || s[7] != ' ') {
+        return false;
+    }
+    // numerday
+    if (!((s[8] >= '0' && s[8] <= '2' && IsDigit(s[9])) || (s[8] == '3' && (s[9] == '0' || s[9] == '1')))) {
+        return false;
+    }
+    // time
+    if (s[10] != ' ' ||
+        !((s[11] >= '0' && s[11] <= '1' && IsDigit(s[12])) || (s[11] == '2' && s[12] >= '0' && s[12] <= '3')) ||
+        s[13] != ':' || !(s[14] >= '0' && s[14] <= '5') || !IsDigit(s[15]) ||
+        s[16] != ':' || !(s[17] >= '0' && s[17] <= '5') || !IsDigit(s[18]) ||
+        s[19] != ' ') {
+        return false;
+    }
+    const char* year = s + 20;
+    if (length == 30) {
+        // timezone
+        if (!(s[20] == '+' || s[20] == '-') ||
+            !((s[21] == '0' && IsDigit(s[22])) || (s[21] == '1' && s[22] >= '0' && s[22] <= '2')) ||
+            !(s[23] >= '0' && s[23] <= '5') || !IsDigit(s[24]) || s[25] != ' ') {
+            return false;
+        }
+        year = s + 26;
+    }
+    return IsDigit(year[0]) && IsDigit(year[1]) && IsDigit(year[2]) && IsDigit(year[3]);
+}
+
+bool AllDigits(const char* s, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        if (!IsDigit(s[i])) {
+            return false;
+        }
+    }
+    return length > 0;
+}
+
+// {float}: -?([0-9]*{frac}{exp}?|[0-9]+{exp}), only called once plain integers were ruled out.
+bool IsFloat(const char* s, size_t length) {
+    size_t i = 0;
+    if (i < length && s[i] == '-') {
+        ++i;
+    }
+    size_t digits = 0;
+    while (i < length && IsDigit(s[i])) {
+        ++i;
+        ++digits;
+    }
+    if (i < length && s[i] == '.') {
+        ++i;
+        digits = 0;
+        while (i < length && IsDigit(s[i])) {
+            ++i;
+            ++digits;
+        }
+    }
+    if (digits == 0) {
+        return false;
+    }
+    if (i < length && (s[i] == 'e' || s[i] == 'E')) {
+        ++i;
+        if (i < length && (s[i] == '-' || s[i] == '+')) {
+            ++i;
+        }
+        digits = 0;
+        while (i < length && IsDigit(s[i])) {
+            ++i;
+            ++digits;
+        }
+        if (digits == 0) {
+            return false;
+        }
+    }
+    return i == length;
+}
+
+bool Equals(const char* s, size_t length, const char* literal) {
+    return length == strlen(literal) && memcmp(s, literal, length) == 0;
+}
+
+// --- The scanner --------------------------------------------------------------------------------------------
+
+struct SimdScanner {
+    ParseContext& Ctx;
+
+    // Stream input, null when scanning a buffer in place.
+    FILE* In = nullptr;
+    // Compressed input, scanned in place a block at a time.
+    CompressedInput* Blocks = nullptr;
+
+    // The bytes [Pos, End) of Data are not scanned yet.
+    const char* Data = nullptr;
+    size_t Pos = 0;
+    size_t End = 0;
+    bool Eof = true;
+
+    // The window over the stream when reading from In.
+    // With Blocks it keeps the unscanned end of a block while the next one is fetched.
+    std::vector<char> Storage;
+
+    // Scans [begin, end) of 'data'.
+    SimdScanner(ParseContext& ctx, const char* data, size_t begin, size_t end)
+        : Ctx(ctx)
+        , Data(data)
+        , Pos(begin)
+        , End(end) {}
+
+    SimdScanner(ParseContext& ctx, FILE* in)
+        : Ctx(ctx)
+        , In(in)
+        , Eof(false) {
+        Storage.resize(StreamBlockSize);
+        Data = Storage.data();
+    }
+
+    SimdScanner(ParseContext& ctx, CompressedInput& in)
+        : Ctx(ctx)
+        , Blocks(&in)
+        , Eof(false) {}
+
+    // Keeps the unscanned bytes and reads more after them. Returns false at the end of the stream.
+    bool Refill() {
+        if (Eof) {
+            return false;
+        }
+        if (Blocks) {
+            return NextBlock();
+        }
+        const size_t pending = End - Pos;
+        memmove(Storage.data(), Storage.data() + Pos, pending);
+        if (Storage.size() - pending < StreamBlockSize / 2) {
+            // A single token bigger than the window, make room for it.
+            Storage.resize(Storage.size() * 2);
+        }
+        Data = Storage.data();
+        Pos = 0;
+        End = pending;
+
+        const size_t read = fread(Storage.data() + End, 1, Storage.size() - End, In);
+        End += read;
+        if (read == 0) {
+            Eof = true;
+        }
+        return true;
+    }
+
+    // Moves on to the next block of Blocks. The unscanned bytes (a token cut by the end of the block) go right
+    // before it, in its headroom, so the block is scanned where it is.
+    bool NextBlock() {
+        // The block they are in is handed back by Next. They may be in Storage already (a token bigger than
+        // the headroom), assign can't copy from the vector itself.
+        const size_t pending = End - Pos;
+        if (Data == Storage.data()) {
+            memmove(Storage.data(), Storage.data() + Pos, pending);
+            Storage.resize(pending);
+        }
+        else {
+            Storage.assign(Data + Pos, Data + End);
+        }
+        Pos = 0;
+
+        char* block;
+        size_t length;
+        if (!Blocks->Next(block, length)) {
+            Data = Storage.data();
+            End = pending;
+            Eof = true;
+        }
+        else if (pending <= CompressedInput::Headroom) {
+            memcpy(block - pending, Storage.data(), pending);
+            Data = block - pending;
+            End = pending + length;
+        }
+        else {
+            // A single token bigger than the headroom, it is put together in Storage.
+            Storage.insert(Storage.end(), block, block + length);
+            Data = Storage.data();
+            End = Storage.size();
+        }
+        return true;
+    }
+
+    // Consumes a matched token (the MATCH of the flex rules).
+    void Match(const char* text, size_t length) {
+        Ctx.Offset += length;
+        Ctx.Parse.Match(text, length, Ctx.Offset - length);
+        Pos += length;
+    }
+
+    // Consumes bytes that no flex rule matches, flex echoes them to its output.
+    void Echo(const char* text, size_t length) {
+        fwrite(text, 1, length, stdout);
+        Ctx.Offset += length;
+        Pos += length;
+    }
+
+    int OpenScope() {
+        if (++Ctx.Depth > Ctx.Settings.MaxDepth && !Ctx.Skipping) {
+            Ctx.Reject(RejectReason::TooDeep, "Nesting is deeper than " + std::to_string(Ctx.Settings.MaxDepth) + " levels.");
+            return YYerror;
+        }
+        return 0;
+    }
+
+    int Next(YYSTYPE* lval) {
+        if (Pos == End) {
+            return Eof ? 0 : NeedMore;
+        }
+
+        const char* p = Data + Pos;
+        const char* end = Data + End;
+        switch (*p) {
+            case ' ':
+            case '\t': {
+                const char* q = SkipSpaces(p, end);
+                if (q == end && !Eof) {
+                    return NeedMore;
+                }
+                Match(p, q - p);
+                return NoToken;
+            }
+            case '\n':
+                Ctx.Offset += 1;
+                Pos += 1;
+                Ctx.Parse.CountLine(Ctx.Offset);
+                return NoToken;
+            case '\r':
+                if (p + 1 == end && !Eof) {
+                    return NeedMore;
+                }
+                if (p + 1 < end && p[1] == '\n') {
+                    Ctx.Offset += 2;
+                    Pos += 2;
+                    Ctx.Parse.CountLine(Ctx.Offset);
+                }
+                else {
+                    Echo(p, 1);
+                }
+                return NoToken;
+            case '{':
+            case '[': {
+                Match(p, 1);
+                const int error = OpenScope();
+                return error ? error : *p;
+            }
+            case '}':
+            case ']':
+                Match(p, 1);
+                --Ctx.Depth;
+                return *p;
+            case ':':
+            case ',':
+                Match(p, 1);
+                return *p;
+            case '"':
+                return ScanString(p, end, lval);
+            default:
+                return ScanWord(p, end, lval);
+        }
+    }
+
+    int ScanString(const char* p, const char* end, YYSTYPE* lval) {
+        const char* q = p + 1;
+        for (;;) {
+            q = FindStringSpecial(q, end);
+            if (q == end) {
+                if (!Eof) {
+                    return NeedMore;
+                }
+                Echo(p, 1); // Unterminated
+                return NoToken;
+            }
+            if (*q == '"') {
+                break;
+            }
+            if (*q != '\\') {
+                Echo(p, 1); // Line break in the string
+                return NoToken;
+            }
+
+            // Escapes: n " \ / uXXXX
+            if (q + 1 >= end) {
+                if (!Eof) {
+                    return NeedMore;
+                }
+                Echo(p, 1);
+                return NoToken;
+            }
+            const char escape = q[1];
+            if (escape == 'n' || escape == '"' || escape == '\\' || escape == '/') {
+                q += 2;
+            }
+            else if (escape == 'u') {
+                if (q + 6 > end && !Eof) {
+                    return NeedMore;
+                }
+                if (q + 6 > end || !IsHex(q[2]) || !IsHex(q[3]) || !IsHex(q[4]) || !IsHex(q[5])) {
+                    Echo(p, 1);
+                    return NoToken;
+                }
+                q += 6;
+            }
+            else {
+                Echo(p, 1);
+                return NoToken;
+            }
+        }
+
+        const char* content = p + 1;
+        const size_t length = q - content;
+        int token;
+        if (AllDigits(content, length)) {
+            token = D_ID_STR;
+        }
+        else if (IsDate(content, length)) {
+            token = D_DATE;
+        }
+        else {
+            token = StringToken(std::string_view(content, length));
+        }
+
+        Match(p, length + 2);
+        lval->AsText = Ctx.QuotedText(p, length + 2);
+        return token;
+    }
+
+    int ScanWord(const char* p, const char* end, YYSTYPE* lval) {
+        const char* q = p;
+        while (q < end && !IsDelimiter(*q)) {
+            ++q;
+        }
+        if (q == end && !Eof) {
+            return NeedMore;
+        }
+
+        const size_t length = q - p;
+        if (AllDigits(p, length) || (p[0] == '-' && AllDigits(p + 1, length - 1))) {
+            Match(p, length);
+            return NumberToken(Ctx, p, length, true, lval);
+        }
+        if (IsFloat(p, length)) {
+            Match(p, length);
+            return NumberToken(Ctx, p, length, false, lval);
+        }
+
+        int token = INVALID_CHARACTER;
+        if (Equals(p, length, "true")) {
+            token = BOOL;
+            lval->AsBool = true;
+        }
+        else if (Equals(p, length, "false")) {
+            token = BOOL;
+            lval->AsBool = false;
+        }
+        else if (Equals(p, length, "null")) {
+            token = NULL_VAL;
+        }
+
+        Match(p, length);
+        return token;
+    }
+};
+
+} // namespace
+
+int yylex(YYSTYPE* lvalp, void* scanner) {
+    SimdScanner& s = *(SimdScanner*)scanner;
+    for (;;) {
+        const int token = s.Next(lvalp);
+        if (token == NeedMore) {
+            s.Refill();
+        }
+        else if (token != NoToken) {
+            return token;
+        }
+    }
+}
+
+int ParseFile(ParseContext& ctx, FILE* in) {
+    SimdScanner scanner(ctx, in);
+    return yyparse(&ctx, &scanner);
+}
+
+int ParseCompressed(ParseContext& ctx, CompressedInput& in) {
+    SimdScanner scanner(ctx, in);
+    return yyparse(&ctx, &scanner);
+}
+
+int ParseBuffer(ParseContext& ctx, const char* data, size_t length) {
+    return ParseRange(ctx, data, 0, length);
+}
+
+int ParseRange(ParseContext& ctx, const char* data, size_t begin, size_t end) {
+    ctx.StartAt(data, begin, end);
+    SimdScanner scanner(ctx, data, begin, end);
+    return yyparse(&ctx, &scanner);
+}
+
+size_t LexBuffer(ParseContext& ctx, const char* data, size_t length) {
+    ctx.StartAt(data, 0, length);
+    SimdScanner scanner(ctx, data, 0, length);
+    YYSTYPE value;
+    size_t tokens = 0;
+    while (yylex(&value, &scanner) != 0) {
+        ++tokens;
+    }
+    return tokens;
+}
@@ -0,0 +1,92 @@
+#ifndef __SIMD_UTIL_H_
+#define __SIMD_UTIL_H_
+
+// Byte searches that look at 16 (SSE2) or 32 (AVX2) bytes at a time, with a plain loop for the tail.
+// They never read outside [p, end) so they are safe at the very end of a mapping.
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+#ifdef __AVX2__
+template <char... Chars>
+inline unsigned int MatchMask32(const char* p) {
+    const __m256i block = _mm256_loadu_si256((const __m256i*)p);
+    __m256i matches = _mm256_setzero_si256();
+    ((matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(Chars)))), ...);
+    return _mm256_movemask_epi8(matches);
+}
+#endif
+
+#ifdef __SSE2__
+template <char... Chars>
+inline unsigned int MatchMask16(const char* p) {
+    const __m128i block = _mm_loadu_si128((const __m128i*)p);
+    __m128i matches = _mm_setzero_si128();
+    ((matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, _mm_set1_epi8(Chars)))), ...);
+    return _mm_movemask_epi8(matches);
+}
+#endif
+
+// First byte of [p, end) that is one of Chars, or end.
+template <char... Chars>
+inline const char* FindAny(const char* p, const char* end) {
+#ifdef __AVX2__
+    for (; p + 32 <= end; p += 32) {
+        const unsigned int mask = MatchMask32<Chars...>(p);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+#ifdef __SSE2__
+    for (; p + 16 <= end; p += 16) {
+        const unsigned int mask = MatchMask16<Chars...>(p);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        if (((*p == Chars) || ...)) {
+            return p;
+        }
+    }
+    return end;
+}
+
+// First byte of [p, end) that is none of Chars, or end.
+template <char... Chars>
+inline const char* SkipAny(const char* p, const char* end) {
+#ifdef __AVX2__
+    for (; p + 32 <= end; p += 32) {
+        const unsigned int mask = ~MatchMask32<Chars...>(p);
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+#ifdef __SSE2__
+    for (; p + 16 <= end; p += 16) {
+        const unsigned int mask = ~MatchMask16<Chars...>(p) & 0xFFFF;
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        if (!((*p == Chars) || ...)) {
+            return p;
+        }
+    }
+    return end;
+}
+
+} // namespace simd
+
+#endif //__SIMD_UTIL_H_
@@ -0,0 +1,221 @@
+#include "tape.h"
+
+TapeKeys::TapeKeys()
+    : Table(256, 0) {
+    for (const schema::Key& key : schema::Keys) {
+        Intern(key.Name);
+    }
+}
+
+uint32_t TapeKeys::Intern(std::string_view name) {
+    const size_t mask = Table.size() - 1;
+    size_t slot = schema::Hash(name, schema::Seed) & mask;
+    while (Table[slot]) {
+        const uint32_t id = Table[slot] - 1;
+        if (Names[id] == name) {
+            return id;
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (Names.size() >= MaxKeys) {
+        return NotInterned;
+    }
+
+    Storage.emplace_back(name);
+    const uint32_t id = (uint32_t)Names.size();
+    Names.push_back(Storage.back());
+    Table[slot] = id + 1;
+    if (Names.size() * 2 > Table.size()) {
+        Grow();
+    }
+    return id;
+}
+
+void TapeKeys::Grow() {
+    std::vector<uint32_t> table(Table.size() * 2, 0);
+    const size_t mask = table.size() - 1;
+    for (uint32_t entry : Table) {
+        if (entry) {
+            size_t slot = schema::Hash(Names[entry - 1], schema::Seed) & mask;
+            while (table[slot]) {
+                slot = (slot + 1) & mask;
+            }
+            table[slot] = entry;
+        }
+    }
+    Table.swap(table);
+}
+
+// Whether a value is of a schema Kind, as the *Slot functions of json_classes.cpp tell.
+#define TAPE_KIND_String(value) ((value).Type() == TapeType::String || (value).Type() == TapeType::Text)
+#define TAPE_KIND_Int(value)    ((value).Type() == TapeType::Int)
+#define TAPE_KIND_Bool(value)   ((value).Type() == TapeType::True || (value).Type() == TapeType::False)
+#define TAPE_KIND_Object(value) ((value).Type() == TapeType::ObjectStart)
+#define TAPE_KIND_Array(value)  ((value).Type() == TapeType::ArrayStart)
+#define TAPE_KIND_Range(value)  ((value).IsRange())
+
+#define TAPE_SET_SLOT(Name, Key, Token, Kind) \
+    case TapeKeys::Id(JSpecialMember::Name): if (TAPE_KIND_##Kind(member.Value)) { Name = member.Value; } break;
+
+TapeSpecialMembers::TapeSpecialMembers(const TapeObject& object) {
+    for (const TapeMember& member : object) {
+        switch (member.Key) {
+            SCHEMA_FIELDS(TAPE_SET_SLOT)
+        }
+    }
+}
+
+#undef TAPE_SET_SLOT
+
+bool TapeObject::FormsValidUser() const {
+    return (bool)TapeSpecialMembers(*this).UScreenName;
+}
+
+bool TapeObject::FormsValidRetweetObj() const {
+    const TapeSpecialMembers Members(*this);
+    // The grammar keeps every "text" as a Text, see JObject::FormsValidRetweetObj.
+    return Members.Text.IsText() && Members.User && !Members.Text.AsText()->RetweetUser.empty();
+}
+
+bool TapeObject::FormsValidRetweetStatus(std::string& FailMessage) const {
+    const TapeSpecialMembers Members(*this);
+    RetweetStatusFields Fields;
+    Fields.HasText = (bool)Members.Text;
+    Fields.HasUser = (bool)Members.User;
+    Fields.HasTweet = (bool)Members.TweetObj;
+    if (Members.User) {
+        const TapeSpecialMembers User(Members.User.AsObject());
+        if (User.UScreenName) {
+            Fields.ScreenName = User.UScreenName.AsString();
+        }
+    }
+    if (Members.TweetObj) {
+        const TapeSpecialMembers Tweet(Members.TweetObj.AsObject());
+        if (Tweet.Text.IsText()) {
+            Fields.RetweetUser = Tweet.Text.AsText()->RetweetUser;
+        }
+    }
+    return ::FormsValidRetweetStatus(Fields, FailMessage);
+}
+
+bool TapeObject::FormsValidOuterObject(std::string& FailMessage) const {
+    const TapeSpecialMembers Members(*this);
+    OuterObjectFields Fields;
+    Fields.HasRequired = Members.IdStr && Members.Text && Members.User && Members.CreatedAt;
+    Fields.TextLength = Members.Text.IsText() ? Members.Text.AsText()->Length : 0;
+    Fields.Truncated = Members.Truncated && Members.Truncated.AsBool();
+    if (Members.DisplayRange) {
+        Fields.HasDisplayRange = true;
+        Fields.DisplayRange = Members.DisplayRange.AsRange();
+    }
+    Fields.HasExTweet = (bool)Members.ExTweet;
+    return ::FormsValidOuterObject(Fields, FailMessage);
+}
+
+bool TapeObject::FormsValidExtendedTweetObj(std::string& FailMessage) const {
+    const TapeSpecialMembers Members(*this);
+    ExtendedTweetFields Fields;
+    if (Members.FullText.IsText()) {
+        Fields.FullText = Members.FullText.AsText();
+    }
+    if (Members.DisplayRange) {
+        Fields.HasDisplayRange = true;
+        Fields.DisplayRange = Members.DisplayRange.AsRange();
+    }
+    // The entities were checked when they were parsed, they have a valid hashtags array.
+    std::vector<HashTagData> Hashtags;
+    if (Members.Entities) {
+        std::string Error;
+        TapeSpecialMembers(Members.Entities.AsObject()).Hashtags.AsArray().ExtractHashtags(&Hashtags, Error);
+        Fields.Hashtags = Hashtags.data();
+        Fields.HashtagCount = Hashtags.size();
+    }
+    return ::FormsValidExtendedTweetObj(Fields, FailMessage);
+}
+
+bool TapeArray::ExtractHashtags(std::vector<HashTagData>* Hashtags, std::string& Error) const {
+    for (const TapeValue Element : *this) {
+        if (Element.Type() != TapeType::ObjectStart) {
+            Error += "An element of the array is not an object.";
+            return false;
+        }
+
+        const TapeSpecialMembers Members(Element.AsObject());
+        JRange Indices;
+        if (Members.Indices) {
+            Indices = Members.Indices.AsRange();
+        }
+        HashTagData Data;
+        if (!HashtagOfEntity(Members.Text.IsText() ? Members.Text.AsText() : nullptr,
+                             Members.Indices ? &Indices : nullptr, Data, Error)) {
+            return false;
+        }
+        if (Hashtags) {
+            Hashtags->push_back(Data);
+        }
+    }
+    return true;
+}
+
+void TapeValue::Print(JsonWriter& out, int indent) const {
+    switch (Type()) {
+        case TapeType::ObjectStart: {
+            const TapeObject object = AsObject();
+            out.Put('{');
+            for (auto it = object.begin(); it != object.end(); ++it) {
+                if (it.Index != Index + 1) {
+                    out.Put(',');
+                }
+                const TapeMember member = *it;
+                out.NewLine(indent + 1);
+                // Names are never decoded, the token text is already valid JSON.
+                out.WriteRawString(member.Name);
+                out.KeySeparator();
+                member.Value.Print(out, indent + 1);
+            }
+            if (object.begin() != object.end()) {
+                out.NewLine(indent);
+            }
+            out.Put('}');
+            break;
+        }
+        case TapeType::ArrayStart: {
+            const TapeArray array = AsArray();
+            out.Put('[');
+            for (auto it = array.begin(); it != array.end(); ++it) {
+                if ((*it).Index != Index + 1) {
+                    out.Put(',');
+                }
+                out.NewLine(indent + 1);
+                (*it).Print(out, indent + 1);
+            }
+            if (array.begin() != array.end()) {
+                out.NewLine(indent);
+            }
+            out.Put(']');
+            break;
+        }
+        case TapeType::String:
+        case TapeType::Text:
+            out.WriteString(AsString());
+            break;
+        case TapeType::BigInt:
+            out.Write(AsString());
+            break;
+        case TapeType::Int:
+            out.WriteInt(AsInt());
+            break;
+        case TapeType::Float:
+            out.WriteFloat(AsFloat());
+            break;
+        case TapeType::True:
+            out.Write("true");
+            break;
+        case TapeType::False:
+            out.Write("false");
+            break;
+        default:
+            out.Write("null");
+            break;
+    }
+}
@@ -0,0 +1,420 @@
+#ifndef __TAPE_H_
+#define __TAPE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+
+#include "schema.h"
+#include "json_classes.h"
+#include "json_writer.h"
+#include "simd_util.h"
+
+// Flat DOM of a record (--tape), instead of a tree of nodes: with a tape the parse builds no nodes at all,
+// the records are printed and checked from their tape.
+// Every key and value is one 64 bit entry in document order, the type in the top 8 bits and a payload in the rest.
+// Strings live in one buffer next to the entries. After warming up building a record costs no allocations
+// and dropping it is clearing a few buffers.
+enum class TapeType : uint8_t {
+    // Payload: index of the matching end entry, so a container is passed over in one step.
+    ObjectStart = '{',
+    ArrayStart = '[',
+    // Payload: index of the matching start entry.
+    ObjectEnd = '}',
+    ArrayEnd = ']',
+    // Payload: interned name (see TapeKeys).
+    Key = 'k',
+    // Payload: offset of the name in the strings, for names that didn't fit in TapeKeys.
+    Name = 'K',
+    // Payload: offset in the strings (decoded text, like JString).
+    String = '"',
+    // A "text" or "full_text" string, which the checks look into. Payload: index in Tape::Texts.
+    Text = 'T',
+    // Payload: offset of the digits in the strings, see ParseSettings::KeepBigInts.
+    BigInt = 'b',
+    // The value is the next entry.
+    Int = 'l',
+    Float = 'd',
+    True = 't',
+    False = 'f',
+    Null = 'n'
+};
+
+// Interned member names, kept for the whole parse since records mostly repeat the same ones.
+// The schema keys are interned up front: the key i of schema::Keys has id i, so special members are found by id.
+struct TapeKeys {
+    // Names beyond this many are not interned (eg: objects keyed by ids), they go in the strings of the record.
+    static const size_t MaxKeys = 64 * 1024;
+    static const uint32_t NotInterned = UINT32_MAX;
+
+    TapeKeys();
+
+    TapeKeys(const TapeKeys&) = delete;
+    TapeKeys& operator=(const TapeKeys&) = delete;
+
+    // Id of a name, NotInterned if there is no room for a new one.
+    uint32_t Intern(std::string_view name);
+
+    std::string_view Name(uint32_t id) const {
+        return Names[id];
+    }
+
+    // Id of a special member name (not JSpecialMember::None).
+    static constexpr uint32_t Id(JSpecialMember member) {
+        return (uint32_t)member - 1;
+    }
+
+private:
+    void Grow();
+
+    // Deque so the views of Names stay valid as it grows.
+    std::deque<std::string> Storage;
+    std::vector<std::string_view> Names;
+    // Open addressing table of the names: id + 1, 0 for empty slots. Never more than half full.
+    std::vector<uint32_t> Table;
+};
+
+struct Tape {
+    static const uint64_t PayloadMask = (1ull << 56) - 1;
+
+    std::vector<uint64_t> Entries;
+    // Each string is its uint32_t length followed by the bytes.
+    std::string Strings;
+    // The Text strings, decoded and measured by the grammar (in the arena of the parse).
+    std::vector<const JString*> Texts;
+    TapeKeys Keys;
+
+    static uint64_t Entry(TapeType type, uint64_t payload = 0) {
+        return (uint64_t)type << 56 | payload;
+    }
+
+    TapeType TypeAt(size_t index) const {
+        return (TapeType)(Entries[index] >> 56);
+    }
+
+    uint64_t PayloadAt(size_t index) const {
+        return Entries[index] & PayloadMask;
+    }
+
+    std::string_view StringAt(uint64_t offset) const {
+        uint32_t length;
+        memcpy(&length, Strings.data() + offset, sizeof(length));
+        return std::string_view(Strings.data() + offset + sizeof(length), length);
+    }
+
+    // Appends a string to Strings, returns its offset.
+    uint64_t AddString(std::string_view text) {
+        const uint64_t offset = Strings.size();
+        const uint32_t length = (uint32_t)text.length();
+        Strings.append((const char*)&length, sizeof(length));
+        Strings.append(text.data(), text.length());
+        return offset;
+    }
+
+    void Clear() {
+        Entries.clear();
+        Strings.clear();
+        Texts.clear();
+    }
+};
+
+struct TapeObject;
+struct TapeArray;
+
+// A value of a tape. A default constructed one is no value at all (eg: a member that is not there).
+struct TapeValue {
+    const Tape* Doc = nullptr;
+    size_t Index = 0;
+
+    explicit operator bool() const {
+        return Doc;
+    }
+
+    TapeType Type() const {
+        return Doc->TypeAt(Index);
+    }
+
+    long long AsInt() const {
+        return (long long)Doc->Entries[Index + 1];
+    }
+
+    double AsFloat() const {
+        double value;
+        memcpy(&value, &Doc->Entries[Index + 1], sizeof(value));
+        return value;
+    }
+
+    bool AsBool() const {
+        return Type() == TapeType::True;
+    }
+
+    // Text of a String or Text, or the digits of a BigInt.
+    std::string_view AsString() const {
+        if (Type() == TapeType::Text) {
+            return AsText()->Text;
+        }
+        return Doc->StringAt(Doc->PayloadAt(Index));
+    }
+
+    // A "text" or "full_text" string, false for no value at all (eg: a special member that is missing).
+    bool IsText() const {
+        return Doc && Type() == TapeType::Text;
+    }
+
+    const JString* AsText() const {
+        return Doc->Texts[Doc->PayloadAt(Index)];
+    }
+
+    // An array of two ints, what the grammar lets through for ranges (see special_intrange).
+    bool IsRange() const {
+        return Type() == TapeType::ArrayStart && Doc->PayloadAt(Index) == Index + 5 &&
+               Doc->TypeAt(Index + 1) == TapeType::Int && Doc->TypeAt(Index + 3) == TapeType::Int;
+    }
+
+    JRange AsRange() const {
+        return JRange(TapeValue { Doc, Index + 1 }.AsInt(), TapeValue { Doc, Index + 3 }.AsInt());
+    }
+
+    TapeObject AsObject() const;
+    TapeArray AsArray() const;
+
+    // Index of the entry right after this value.
+    size_t End() const {
+        switch (Type()) {
+            case TapeType::ObjectStart:
+            case TapeType::ArrayStart:
+                return Doc->PayloadAt(Index) + 1;
+            case TapeType::Int:
+            case TapeType::Float:
+                return Index + 2;
+            default:
+                return Index + 1;
+        }
+    }
+
+    // Same output as JValue::Print.
+    void Print(JsonWriter& out, int indentation) const;
+};
+
+struct TapeMember {
+    // Interned name, TapeKeys::NotInterned for names kept in the strings.
+    uint32_t Key;
+    std::string_view Name;
+    TapeValue Value;
+};
+
+struct TapeObject {
+    const Tape* Doc;
+    // Of the ObjectStart entry.
+    size_t Index;
+
+    struct Iterator {
+        const Tape* Doc;
+        // Of the name entry of the member.
+        size_t Index;
+
+        TapeMember operator*() const {
+            const bool interned = Doc->TypeAt(Index) == TapeType::Key;
+            const uint64_t payload = Doc->PayloadAt(Index);
+            return TapeMember {
+                interned ? (uint32_t)payload : TapeKeys::NotInterned,
+                interned ? Doc->Keys.Name((uint32_t)payload) : Doc->StringAt(payload),
+                TapeValue { Doc, Index + 1 }
+            };
+        }
+
+        Iterator& operator++() {
+            Index = TapeValue { Doc, Index + 1 }.End();
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return Index != other.Index;
+        }
+    };
+
+    Iterator begin() const {
+        return Iterator { Doc, Index + 1 };
+    }
+
+    Iterator end() const {
+        return Iterator { Doc, Doc->PayloadAt(Index) };
+    }
+
+    // Same checks as the JObject (and JSpecialMembers) ones.
+    bool FormsValidUser() const;
+    bool FormsValidRetweetObj() const;
+    bool FormsValidRetweetStatus(std::string& FailMessage) const;
+    bool FormsValidOuterObject(std::string& FailMessage) const;
+    bool FormsValidExtendedTweetObj(std::string& FailMessage) const;
+};
+
+struct TapeArray {
+    const Tape* Doc;
+    // Of the ArrayStart entry.
+    size_t Index;
+
+    struct Iterator {
+        TapeValue Value;
+
+        TapeValue operator*() const {
+            return Value;
+        }
+
+        Iterator& operator++() {
+            Value.Index = Value.End();
+            return *this;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return Value.Index != other.Value.Index;
+        }
+    };
+
+    Iterator begin() const {
+        return Iterator { TapeValue { Doc, Index + 1 } };
+    }
+
+    Iterator end() const {
+        return Iterator { TapeValue { Doc, Doc->PayloadAt(Index) } };
+    }
+
+    // Same as JArray::ExtractHashtags, the hashtags are added to 'Hashtags' (if not null, to only check them).
+    bool ExtractHashtags(std::vector<HashTagData>* Hashtags, std::string& Error) const;
+};
+
+#define TAPE_DECLARE_SLOT(Name, Key, Token, Kind) TapeValue Name;
+
+// The special members of a tape object, found in one pass over its members. Like the slots of a JObject
+// the last member of a name wins and only values of its kind count, a slot is no value otherwise.
+struct TapeSpecialMembers {
+    SCHEMA_FIELDS(TAPE_DECLARE_SLOT)
+
+    explicit TapeSpecialMembers(const TapeObject& object);
+};
+
+#undef TAPE_DECLARE_SLOT
+
+inline TapeObject TapeValue::AsObject() const {
+    return TapeObject { Doc, Index };
+}
+
+inline TapeArray TapeValue::AsArray() const {
+    return TapeArray { Doc, Index };
+}
+
+// Builds the tape of each record from the parse events. Takes the same events as a JsonHandler,
+// called directly by the grammar (see EMIT) next to the one in ParseContext::Handler.
+struct TapeBuilder {
+    Tape Doc;
+
+    void StartObject() {
+        Open(TapeType::ObjectStart);
+    }
+
+    void EndObject() {
+        Close(TapeType::ObjectEnd);
+    }
+
+    void StartArray() {
+        Open(TapeType::ArrayStart);
+    }
+
+    void EndArray() {
+        Close(TapeType::ArrayEnd);
+    }
+
+    void Key(std::string_view name) {
+        const uint32_t id = Doc.Keys.Intern(name);
+        if (id != TapeKeys::NotInterned) {
+            Doc.Entries.push_back(Tape::Entry(TapeType::Key, id));
+        }
+        else {
+            Doc.Entries.push_back(Tape::Entry(TapeType::Name, Doc.AddString(name)));
+        }
+    }
+
+    // A "text" or "full_text" string, already decoded by the grammar. It must live as long as the record.
+    void Text(const JString* text) {
+        Doc.Entries.push_back(Tape::Entry(TapeType::Text, Doc.Texts.size()));
+        Doc.Texts.push_back(text);
+    }
+
+    // Raw token text, decoded on the tape.
+    void String(std::string_view text) {
+        if (simd::FindAny<'\\', '%'>(text.data(), text.data() + text.length()) == text.data() + text.length()) {
+            // Nothing to decode.
+            Doc.Entries.push_back(Tape::Entry(TapeType::String, Doc.AddString(text)));
+            return;
+        }
+        const uint64_t offset = Doc.Strings.size();
+        Doc.Strings.resize(offset + sizeof(uint32_t) + text.length());
+        const uint32_t length = (uint32_t)DecodeText(TextRef { text.data(), text.length() }, &Doc.Strings[offset + sizeof(uint32_t)]);
+        memcpy(&Doc.Strings[offset], &length, sizeof(length));
+        Doc.Strings.resize(offset + sizeof(length) + length);
+        Doc.Entries.push_back(Tape::Entry(TapeType::String, offset));
+    }
+
+    void Int(long long value) {
+        Doc.Entries.push_back(Tape::Entry(TapeType::Int));
+        Doc.Entries.push_back((uint64_t)value);
+    }
+
+    void Float(double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        Doc.Entries.push_back(Tape::Entry(TapeType::Float));
+        Doc.Entries.push_back(bits);
+    }
+
+    void BigInt(std::string_view digits) {
+        Doc.Entries.push_back(Tape::Entry(TapeType::BigInt, Doc.AddString(digits)));
+    }
+
+    void Bool(bool value) {
+        Doc.Entries.push_back(Tape::Entry(value ? TapeType::True : TapeType::False));
+    }
+
+    void Null() {
+        Doc.Entries.push_back(Tape::Entry(TapeType::Null));
+    }
+
+    // The record is done, the next one starts from an empty tape.
+    void EndRecord(bool /*accepted*/) {
+        Doc.Clear();
+        Opened.clear();
+    }
+
+    // The record being built, its first value.
+    TapeValue Root() const {
+        return TapeValue { &Doc, 0 };
+    }
+
+    // The object or array closed last. While the grammar reduces a member this is its value.
+    TapeValue LastClosed() const {
+        return TapeValue { &Doc, Closed };
+    }
+
+private:
+    void Open(TapeType type) {
+        Opened.push_back(Doc.Entries.size());
+        Doc.Entries.push_back(Tape::Entry(type));
+    }
+
+    void Close(TapeType type) {
+        const size_t start = Opened.back();
+        Opened.pop_back();
+        Doc.Entries[start] = Tape::Entry(Doc.TypeAt(start), Doc.Entries.size());
+        Doc.Entries.push_back(Tape::Entry(type, start));
+        Closed = start;
+    }
+
+    // Containers of the record that are still open.
+    std::vector<size_t> Opened;
+    size_t Closed = 0;
+};
+
+#endif //__TAPE_H_
@@ -0,0 +1,64 @@
+#ifndef __TWITTER_DATE_H_
+#define __TWITTER_DATE_H_
+
+#include <string.h>
+#include <string_view>
+
+// Days from 1970-01-01 to the given date of the proleptic Gregorian calendar.
+inline long long DaysFromCivil(long long year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const long long era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yearOfEra = (unsigned)(year - era * 400);
+    const unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + (long long)dayOfEra - 719468;
+}
+
+// Seconds since the epoch (UTC) of a created_at value: "Thu May 10 17:41:57 +0000 2018", the timezone is optional.
+// Returns false if the text does not have that shape (every D_DATE token does).
+inline bool ParseCreatedAt(std::string_view text, long long& epoch) {
+    static const char Months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+    if (text.length() != 24 && text.length() != 30) {
+        return false;
+    }
+    auto number = [&](size_t at, size_t digits) {
+        long long value = 0;
+        for (size_t i = at; i < at + digits; ++i) {
+            if (text[i] < '0' || text[i] > '9') {
+                return -1LL;
+            }
+            value = value * 10 + (text[i] - '0');
+        }
+        return value;
+    };
+
+    unsigned month = 0;
+    while (month < 12 && memcmp(Months + month * 3, text.data() + 4, 3) != 0) {
+        ++month;
+    }
+    const long long day = number(8, 2);
+    const long long hours = number(11, 2);
+    const long long minutes = number(14, 2);
+    const long long seconds = number(17, 2);
+
+    long long offset = 0;
+    size_t yearAt = 20;
+    if (text.length() == 30) {
+        const long long zone = number(21, 4);
+        if (zone < 0 || (text[20] != '+' && text[20] != '-')) {
+            return false;
+        }
+        offset = (zone / 100 * 60 + zone % 100) * 60 * (text[20] == '-' ? -1 : 1);
+        yearAt = 26;
+    }
+    const long long year = number(yearAt, 4);
+
+    if (month == 12 || day < 0 || hours < 0 || minutes < 0 || seconds < 0 || year < 0) {
+        return false;
+    }
+    epoch = DaysFromCivil(year, month + 1, (unsigned)day) * 86400 + hours * 3600 + minutes * 60 + seconds - offset;
+    return true;
+}
+
+#endif //__TWITTER_DATE_H_
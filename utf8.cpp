@@ -0,0 +1,238 @@
+#include "utf8.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+// Decodes the sequence at 'p' (p < end), returns where the next one starts.
+// Bytes that aren't continuation bytes are counted, so a broken sequence counts the same as it would in the vector version.
+static const unsigned char* ScalarStep(const unsigned char* p, const unsigned char* end, size_t& count, bool& valid) {
+    const unsigned char c = *p++;
+    if (c < 0x80) {
+        ++count;
+        return p;
+    }
+    if (c < 0xC0) {
+        // Continuation byte without a lead.
+        valid = false;
+        return p;
+    }
+    ++count;
+
+    // Bytes still needed and the allowed range of the first one, which rules out overlongs,
+    // surrogates (ED A0..BF) and anything above U+10FFFF.
+    int needed;
+    unsigned char low = 0x80;
+    unsigned char high = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        needed = 1;
+    }
+    else if (c == 0xE0) {
+        needed = 2;
+        low = 0xA0;
+    }
+    else if (c == 0xED) {
+        needed = 2;
+        high = 0x9F;
+    }
+    else if (c >= 0xE1 && c <= 0xEF) {
+        needed = 2;
+    }
+    else if (c == 0xF0) {
+        needed = 3;
+        low = 0x90;
+    }
+    else if (c >= 0xF1 && c <= 0xF3) {
+        needed = 3;
+    }
+    else if (c == 0xF4) {
+        needed = 3;
+        high = 0x8F;
+    }
+    else {
+        // C0, C1 (always overlong) and F5..FF.
+        valid = false;
+        return p;
+    }
+
+    for (int i = 0; i < needed; ++i, ++p) {
+        if (p == end || *p < low || *p > high) {
+            // Left for the next step, a continuation byte there is reported (and not counted) on its own.
+            valid = false;
+            return p;
+        }
+        low = 0x80;
+        high = 0xBF;
+    }
+    return p;
+}
+
+size_t Utf8LengthScalar(const char* text, size_t length, bool& valid) {
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    size_t count = 0;
+    while (p < end) {
+        p = ScalarStep(p, end, count, valid);
+    }
+    return count;
+}
+
+#ifdef __SSSE3__
+
+// Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+// Every error is seen in (at most) the last byte of a pair: the high nibble of the previous byte, its low nibble and
+// the high nibble of the current byte each look up a set of the errors they allow and a pair is bad if the three agree.
+// The 3rd and 4th bytes of long sequences are checked with the leads two and three bytes back.
+namespace {
+
+const unsigned char TooShort = 1 << 0;  // 11______ 0_______ / 11______ 11______
+const unsigned char TooLong = 1 << 1;   // 0_______ 10______
+const unsigned char Overlong3 = 1 << 2; // 11100000 100_____
+const unsigned char TooLarge = 1 << 3;  // 11110100 1001____ / 11110100 101_____ / 11110101+ 10______
+const unsigned char Surrogate = 1 << 4; // 11101101 101_____
+const unsigned char Overlong2 = 1 << 5; // 1100000_ 10______
+const unsigned char TwoConts = 1 << 7;  // 10______ 10______
+const unsigned char TooLarge1000 = 1 << 6; // 11110101+ 1000____
+const unsigned char Overlong4 = 1 << 6;    // 11110000 1000____
+const unsigned char Carry = TooShort | TooLong | TwoConts;
+
+template <int N>
+inline __m128i Prev(__m128i input, __m128i previous) {
+    return _mm_alignr_epi8(input, previous, 16 - N);
+}
+
+inline __m128i HighNibbles(__m128i bytes) {
+    return _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+}
+
+inline __m128i SpecialCases(__m128i input, __m128i prev1) {
+    const __m128i byte1High = _mm_shuffle_epi8(_mm_setr_epi8(
+        TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+        TwoConts, TwoConts, TwoConts, TwoConts,
+        TooShort | Overlong2,
+        TooShort,
+        TooShort | Overlong3 | Surrogate,
+        TooShort | TooLarge | TooLarge1000 | Overlong4), HighNibbles(prev1));
+
+    const __m128i byte1Low = _mm_shuffle_epi8(_mm_setr_epi8(
+        Carry | Overlong3 | Overlong2 | Overlong4,
+        Carry | Overlong2,
+        Carry,
+        Carry,
+        Carry | TooLarge,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000 | Surrogate,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000), _mm_and_si128(prev1, _mm_set1_epi8(0x0F)));
+
+    const __m128i byte2High = _mm_shuffle_epi8(_mm_setr_epi8(
+        TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+        TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4,
+        TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,
+        TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+        TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+        TooShort, TooShort, TooShort, TooShort), HighNibbles(input));
+
+    return _mm_and_si128(_mm_and_si128(byte1High, byte1Low), byte2High);
+}
+
+struct Utf8Checker {
+    __m128i Error = _mm_setzero_si128();
+    __m128i Previous = _mm_setzero_si128();
+    // Lead bytes at the end of the previous block still waiting for continuation bytes.
+    __m128i Incomplete = _mm_setzero_si128();
+    size_t Count = 0;
+
+    void Block(__m128i input) {
+        // Everything but continuation bytes (0x80..0xBF are -128..-65 as signed bytes).
+        Count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(input, _mm_set1_epi8(-65))));
+
+        if (!_mm_movemask_epi8(input)) {
+            // ASCII, only a sequence left open by the previous block can be wrong.
+            Error = _mm_or_si128(Error, Incomplete);
+            Incomplete = _mm_setzero_si128();
+            Previous = input;
+            return;
+        }
+
+        const __m128i prev1 = Prev<1>(input, Previous);
+        const __m128i special = SpecialCases(input, prev1);
+        // Only 111_____ two bytes back or 1111____ three bytes back leave the top bit set.
+        const __m128i third = _mm_subs_epu8(Prev<2>(input, Previous), _mm_set1_epi8(char(0xE0 - 0x80)));
+        const __m128i fourth = _mm_subs_epu8(Prev<3>(input, Previous), _mm_set1_epi8(char(0xF0 - 0x80)));
+        const __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8(char(0x80)));
+        Error = _mm_or_si128(Error, _mm_xor_si128(must23, special));
+
+        Incomplete = _mm_subs_epu8(input, _mm_setr_epi8(
+            char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF),
+            char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF),
+            char(0xF0 - 1), char(0xE0 - 1), char(0xC0 - 1)));
+        Previous = input;
+    }
+
+    bool Valid() {
+        const __m128i error = _mm_or_si128(Error, Incomplete);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+    }
+};
+
+} // namespace
+
+size_t Utf8Length(const char* text, size_t length, bool& valid) {
+    Utf8Checker checker;
+    const char* p = text;
+    const char* end = text + length;
+    for (; p + 16 <= end; p += 16) {
+        checker.Block(_mm_loadu_si128((const __m128i*)p));
+    }
+    if (p < end) {
+        // Zero (ASCII) padding, which doesn't hide a sequence cut at the end but adds to the count.
+        alignas(16) char tail[16] = {};
+        memcpy(tail, p, end - p);
+        checker.Block(_mm_load_si128((const __m128i*)tail));
+        checker.Count -= 16 - (end - p);
+    }
+    if (!checker.Valid()) {
+        valid = false;
+    }
+    return checker.Count;
+}
+
+#else
+
+size_t Utf8Length(const char* text, size_t length, bool& valid) {
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    size_t count = 0;
+#ifdef __SSE2__
+    while (p + 16 <= end) {
+        if (!_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p))) {
+            count += 16;
+            p += 16;
+            continue;
+        }
+        const unsigned char* stop = p + 16;
+        while (p < stop) {
+            p = ScalarStep(p, end, count, valid);
+        }
+    }
+#endif
+    while (p < end) {
+        p = ScalarStep(p, end, count, valid);
+    }
+    return count;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __UTF8_H_
+#define __UTF8_H_
+
+#include <stddef.h>
+
+// Counts the code points of a UTF-8 text and validates it in the same pass.
+// 'valid' is set to false if the text has invalid UTF-8 (bad/missing continuation bytes, overlong forms,
+// surrogates, code points above U+10FFFF or a sequence cut at the end), it is left alone otherwise.
+// For invalid text the count is the number of bytes that are not continuation bytes.
+//
+// Checks 16 bytes at a time with the SSSE3 lookup tables when available (eg: SIMD_FLAGS=-mavx2),
+// otherwise only runs of ASCII are skipped 16 bytes at a time.
+size_t Utf8Length(const char* text, size_t length, bool& valid);
+
+// Byte at a time version of the above, same results. Used for the tails and as a baseline.
+size_t Utf8LengthScalar(const char* text, size_t length, bool& valid);
+
+#endif //__UTF8_H_
@@ -0,0 +1,81 @@
+// Throughput of Utf8Length against Utf8LengthScalar (make utf8-bench).
+// Texts are generated from a fixed seed and split in tweet sized strings since that is what JString sees.
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+
+#include "utf8.h"
+
+struct Mix {
+    const char* Name;
+    // Share of non ASCII characters (in %) and what they are.
+    int NonAscii;
+    std::vector<const char*> Pieces;
+};
+
+static std::vector<std::string> Generate(const Mix& mix, size_t totalBytes, size_t stringChars) {
+    std::mt19937 rng(42);
+    std::vector<std::string> strings;
+    size_t bytes = 0;
+    while (bytes < totalBytes) {
+        std::string text;
+        for (size_t i = 0; i < stringChars; ++i) {
+            if ((int)(rng() % 100) < mix.NonAscii) {
+                text += mix.Pieces[rng() % mix.Pieces.size()];
+            }
+            else {
+                text += (char)('a' + rng() % 26);
+            }
+        }
+        bytes += text.size();
+        strings.push_back(std::move(text));
+    }
+    return strings;
+}
+
+template <typename F>
+static double Measure(const std::vector<std::string>& strings, size_t bytes, F count) {
+    size_t total = 0;
+    bool valid = true;
+    auto best = std::chrono::duration<double>::max();
+    for (int round = 0; round < 5; ++round) {
+        const auto start = std::chrono::steady_clock::now();
+        for (const std::string& text : strings) {
+            total += count(text.data(), text.size(), valid);
+        }
+        best = std::min<std::chrono::duration<double>>(best, std::chrono::steady_clock::now() - start);
+    }
+    if (!valid || !total) {
+        fprintf(stderr, "unexpected invalid text\n");
+    }
+    return bytes / best.count() / 1e6;
+}
+
+int main() {
+    const std::vector<Mix> mixes = {
+        {"ascii", 0, {}},
+        {"latin", 10, {"\xC3\xA9", "\xC3\xB6", "\xC3\xB1"}},
+        {"greek", 90, {"\xCE\xB1", "\xCE\xB2", "\xCF\x89"}},
+        {"cjk", 90, {"\xE4\xB8\xAD", "\xE6\x96\x87", "\xE5\xAD\x97"}},
+        {"emoji", 20, {"\xF0\x9F\x98\x80", "\xF0\x9F\x94\xA5", "\xE2\x9D\xA4"}},
+    };
+    const size_t totalBytes = 64 << 20;
+
+    printf("%-8s %8s %12s %12s %8s\n", "mix", "chars", "scalar MB/s", "vector MB/s", "speedup");
+    for (const Mix& mix : mixes) {
+        for (size_t chars : {140, 800, 65536}) {
+            const std::vector<std::string> strings = Generate(mix, totalBytes, chars);
+            size_t bytes = 0;
+            for (const std::string& text : strings) {
+                bytes += text.size();
+            }
+            const double scalar = Measure(strings, bytes, Utf8LengthScalar);
+            const double vector = Measure(strings, bytes, Utf8Length);
+            printf("%-8s %8zu %12.0f %12.0f %7.2fx\n", mix.Name, chars, scalar, vector, vector / scalar);
+        }
+    }
+    return 0;
+}